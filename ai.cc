@@ -25,6 +25,7 @@
 #endif // WIN32
 
 #include "character.h"
+#include "conv.h"
 #include "font.h"
 #include "logger.h"
 #include "misc.h"
@@ -40,6 +41,35 @@ namespace {
     }
     const auto SD_SEND = SHUT_WR;
 #endif
+    // 表示範囲より上に残しておく行数、0なら無制限
+    // 今までと同じく既定では捨てない
+    constexpr int kDefaultScrollback = 0;
+
+    Descript parseDescript(const std::filesystem::path &path) {
+        Descript descript;
+        std::istringstream iss(util::readDescript(path));
+        std::string value;
+        while (std::getline(iss, value, '\n')) {
+            auto pos = value.find(',');
+            if (pos == std::string::npos) {
+                continue;
+            }
+            auto key = value.substr(0, pos);
+            value = value.substr(pos + 1);
+            descript[key] = value;
+        }
+        return descript;
+    }
+
+    // Charsetが指定されていればUTF-8に直してから読み直す
+    template<typename T>
+    T parseMessage(const std::string &data) {
+        auto message = T::parse(data);
+        if (message["Charset"] && !isUTF8(message["Charset"].value())) {
+            return T::parse(conv(data, "UTF-8", message["Charset"].value()));
+        }
+        return message;
+    }
 }
 
 Ai::~Ai() {
@@ -55,7 +85,7 @@ Ai::~Ai() {
 #endif // Windows
 }
 
-Ai::Ai() : alive_(true), loaded_(false), redrawn_(false) {
+Ai::Ai() : alive_(true), loaded_(false), redrawn_(false), scrollback_(kDefaultScrollback), first_balloon_(false) {
 #ifdef IS_WINDOWS
     WSADATA wsa;
     WSAStartup(MAKEWORD(2, 2), &wsa);
@@ -77,7 +107,7 @@ Ai::Ai() : alive_(true), loaded_(false), redrawn_(false) {
             if (std::cin.gcount() < len) {
                 break;
             }
-            auto req = sorakado::Request::parse(request);
+            auto req = parseMessage<sorakado::Request>(request);
             Logger::log(request);
             auto event = req().value();
 
@@ -142,20 +172,8 @@ Ai::Ai() : alive_(true), loaded_(false), redrawn_(false) {
     ai_dir_ = "./balloon";
 #endif // DEBUG
 
-    {
-        std::string descript = util::readDescript(ai_dir_ / "descript.txt");
-        std::istringstream iss(descript);
-        std::string value;
-        while (std::getline(iss, value, '\n')) {
-            auto pos = value.find(',');
-            if (pos == std::string::npos) {
-                continue;
-            }
-            auto key = value.substr(0, pos);
-            value = value.substr(pos + 1);
-            info_[key] = value;
-        }
-    }
+    initialized_ = std::chrono::steady_clock::now();
+    info_ = parseDescript(ai_dir_ / "descript.txt");
 
 #ifdef IS_WINDOWS
     std::wstring exe_path;
@@ -170,6 +188,9 @@ Ai::Ai() : alive_(true), loaded_(false), redrawn_(false) {
     exe_dir = exe_dir.parent_path();
     image_cache_ = std::make_unique<ImageCache>(ai_dir_, exe_dir, false);
     font_cache_ = std::make_unique<FontCache>();
+    watcher_ = std::make_unique<BalloonWatcher>(ai_dir_, image_cache_);
+    // 最初のShowが来るまでに読み込んでおく
+    image_cache_->preload();
 #if defined(DEBUG)
     auto family = fontlist::get_default_font();
     font_cache_->setDefaultFont(family);
@@ -188,7 +209,7 @@ Ai::Ai() : alive_(true), loaded_(false), redrawn_(false) {
                 event_queue_.pop();
             }
             for (auto &request : list) {
-                auto res = sstp::Response::parse(sendDirectSSTP(request.method, request.command, request.args, request.script));
+                auto res = parseMessage<sstp::Response>(sendDirectSSTP(request.method, request.command, request.args, request.script));
                 if (res.getStatusCode() != 204) {
                     break;
                 }
@@ -197,12 +218,29 @@ Ai::Ai() : alive_(true), loaded_(false), redrawn_(false) {
     });
 }
 
-std::string Ai::getInfo(int id, std::string key, std::string default_) {
-    // TODO implement override[id][key]
-    if (info_.contains(key) && !info_.at(key).empty()) {
-        return info_.at(key);
+const Descript &Ai::getOverride(int side, int id) {
+    auto key = std::make_pair(side, id);
+    if (!override_.contains(key)) {
+        Descript descript;
+        if (side != -1 && id != -1) {
+            std::filesystem::path filename = util::balloonSide2str(side, id, false);
+            filename = filename.stem();
+            filename += "s.txt";
+            if (std::filesystem::exists(ai_dir_ / filename)) {
+                descript = parseDescript(ai_dir_ / filename);
+            }
+        }
+        override_.emplace(key, std::move(descript));
     }
-    return default_;
+    return override_.at(key);
+}
+
+const BalloonConfig *Ai::getBalloonConfig(int side, int id) {
+    auto key = std::make_pair(side, id);
+    if (!balloon_config_.contains(key)) {
+        balloon_config_.emplace(key, BalloonConfig(info_, getOverride(side, id)));
+    }
+    return &balloon_config_.at(key);
 }
 
 
@@ -215,6 +253,7 @@ void Ai::create(int side) {
     oss << "Balloon(" << side << ")";
     auto name = oss.str();
     characters_.emplace(side, std::make_unique<Character>(this, image_cache_, font_cache_, side, name.c_str()));
+    characters_.at(side)->setScrollback(scrollback_);
     if (util::isWayland() && getenv("NINIX_ENABLE_MULTI_MONITOR")) {
         int count = 0;
         auto *monitors = SDL_GetDisplays(&count);
@@ -235,6 +274,13 @@ void Ai::setScale(int scale) {
     }
 }
 
+void Ai::setScrollback(int lines) {
+    scrollback_ = lines;
+    for (auto &[_k, v] : characters_) {
+        v->setScrollback(lines);
+    }
+}
+
 void Ai::show(int side) {
     if (!characters_.contains(side)) {
         return;
@@ -338,9 +384,93 @@ void Ai::clearCache() {
     }
 }
 
+void Ai::reload() {
+    BalloonWatcher::Result result;
+    if (!watcher_ || !watcher_->fetch(result)) {
+        return;
+    }
+    if (result.descript_changed) {
+        Logger::log("reload: descript");
+        info_ = parseDescript(ai_dir_ / "descript.txt");
+        override_.clear();
+        // 各所でポインタを保持しているので中身だけ入れ替える
+        for (auto &[k, v] : balloon_config_) {
+            v = BalloonConfig(info_, getOverride(k.first, k.second));
+        }
+    }
+    std::vector<std::filesystem::path> paths;
+    for (auto &[path, info] : result.images) {
+        image_cache_->update(path, std::move(info));
+        paths.push_back(path);
+    }
+    // 変更された画像を使っているキャラクターだけ作り直す
+    for (auto &[_, v] : characters_) {
+        bool affected = result.descript_changed;
+        for (auto &path : paths) {
+            affected = affected || v->uses(path);
+        }
+        if (affected) {
+            v->reload();
+        }
+    }
+    // 開いている入力ボックスも同じく作り直す
+    std::vector<BaseInputBox *> boxes;
+    if (script_inputbox_) {
+        boxes.push_back(script_inputbox_.get());
+    }
+    for (auto &[_, v] : inputbox_) {
+        boxes.push_back(v.get());
+    }
+    for (auto *box : boxes) {
+        bool affected = result.descript_changed;
+        for (auto &path : paths) {
+            affected = affected || path.filename() == box->filename();
+        }
+        if (affected) {
+            box->reload(image_cache_);
+        }
+    }
+}
+
+void Ai::upconverted(const std::filesystem::path &path) {
+    for (auto &[_, v] : characters_) {
+        if (v->uses(path)) {
+            v->change();
+        }
+    }
+}
+
+void Ai::enqueueMotion(const SDL_MouseMotionEvent &event) {
+    for (auto &e : motion_queue_) {
+        if (e.windowID == event.windowID) {
+            float xrel = e.xrel + event.xrel;
+            float yrel = e.yrel + event.yrel;
+            e = event;
+            e.xrel = xrel;
+            e.yrel = yrel;
+            return;
+        }
+    }
+    motion_queue_.push_back(event);
+}
+
+void Ai::dispatchMotion() {
+    for (auto &e : motion_queue_) {
+        for (auto &[_, v] : characters_) {
+            v->motion(e);
+        }
+    }
+    motion_queue_.clear();
+}
+
 void Ai::run() {
     SDL_Event event;
     while ((redrawn_) ? (SDL_PollEvent(&event)) : (SDL_WaitEventTimeout(&event, 10))) {
+        // 1ループ中のmotionはウィンドウ毎に最新のものだけを処理する
+        // それ以外のイベントとの順序は保つ
+        if (event.type != SDL_EVENT_MOUSE_MOTION) {
+            dispatchMotion();
+        }
         switch (event.type) {
             case SDL_EVENT_QUIT:
                 alive_ = false;
@@ -360,9 +490,7 @@ void Ai::run() {
                 }
                 break;
             case SDL_EVENT_MOUSE_MOTION:
-                for (auto &[_, v] : characters_) {
-                    v->motion(event.motion);
-                }
+                enqueueMotion(event.motion);
                 break;
             case SDL_EVENT_MOUSE_BUTTON_DOWN:
             case SDL_EVENT_MOUSE_BUTTON_UP:
@@ -405,9 +533,15 @@ void Ai::run() {
                 }
                 break;
             default:
+                if (image_cache_ && event.type == image_cache_->eventType()) {
+                    std::unique_ptr<std::filesystem::path> path(static_cast<std::filesystem::path *>(event.user.data1));
+                    upconverted(*path);
+                }
                 break;
         }
     }
+    dispatchMotion();
+    reload();
 
     if (script_inputbox_ && !script_inputbox_->alive()) {
         script_inputbox_.reset();
@@ -474,11 +608,41 @@ void Ai::run() {
                     if (scale < 10) {
                         continue;
                     }
-                    clearCache();
+                    // 元画像はそのまま使うのでテクスチャだけ捨てる
+                    for (auto &[_, v] : characters_) {
+                        v->clearCache();
+                    }
                     image_cache_->setScale(scale);
                     changed = true;
                     setScale(scale);
                 }
+                if (key == "scrollback") {
+                    int lines = -1;
+                    util::to_x(value, lines);
+                    if (lines < 0) {
+                        continue;
+                    }
+                    setScrollback(lines);
+                }
+                // linear, bicubic, lanczos3, pixelart
+                if (key == "resampler") {
+                    image_cache_->setFilter(resample::parse(value));
+                    for (auto &[_, v] : characters_) {
+                        v->clearCache();
+                        v->reload();
+                    }
+                }
+                // 画像キャッシュの上限(MB)、0なら無制限
+                if (key == "cachesize") {
+                    int mb = -1;
+                    util::to_x(value, mb);
+                    if (mb < 0) {
+                        continue;
+                    }
+                    image_cache_->setBudget(static_cast<size_t>(mb) * 1024 * 1024);
+                    auto stats = image_cache_->stats();
+                    Logger::log("image cache:", stats.used, "/", stats.budget, "bytes, evicted", stats.evictions, "images", stats.evicted_bytes, "bytes");
+                }
                 if (key == "font") {
                     auto &font = font_cache_->getDefaultFont();
                     if (font && font->name() == value) {
@@ -612,6 +776,11 @@ void Ai::run() {
     std::sort(keys.begin(), keys.end());
     for (auto k : keys) {
         characters_.at(k)->draw();
+        if (!first_balloon_ && characters_.at(k)->drawn()) {
+            first_balloon_ = true;
+            auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - initialized_);
+            Logger::log("time to first balloon:", elapsed.count(), "ms");
+        }
     }
     redrawn_ = false;
     if (script_inputbox_) {
@@ -1,10 +1,12 @@
 #ifndef AI_H_
 #define AI_H_
 
+#include <chrono>
 #include <condition_variable>
 #include <cstdlib>
 #include <filesystem>
 #include <iostream>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <optional>
@@ -15,6 +17,10 @@
 #include <unordered_set>
 #include <vector>
 
+#include <SDL3/SDL_events.h>
+
+#include "balloon_config.h"
+#include "balloon_watcher.h"
 #include "character.h"
 #include "font_cache.h"
 #include "image_cache.h"
@@ -32,17 +38,29 @@ class Ai {
         std::unique_ptr<std::thread> th_recv_;
         std::unique_ptr<std::thread> th_send_;
         std::filesystem::path ai_dir_;
-        std::unordered_map<std::string, std::string> info_;
+        Descript info_;
+        // 吹き出し画像毎の個別設定(balloons0s.txtなど)
+        std::map<std::pair<int, int>, Descript> override_;
+        std::map<std::pair<int, int>, BalloonConfig> balloon_config_;
         std::unordered_map<int, std::unique_ptr<Character>> characters_;
         std::unordered_map<std::string, std::unique_ptr<InputBox>> inputbox_;
         std::unique_ptr<ScriptInputBox> script_inputbox_;
         std::unique_ptr<ImageCache> image_cache_;
         std::unique_ptr<FontCache> font_cache_;
+        // image_cache_を参照するので後に置く
+        std::unique_ptr<BalloonWatcher> watcher_;
+        std::vector<SDL_MouseMotionEvent> motion_queue_;
         std::string path_;
         std::string uuid_;
         bool alive_;
         bool loaded_;
         bool redrawn_;
+        int scrollback_;
+        // Initializeから最初に吹き出しを描くまでの時間を測る
+        std::chrono::steady_clock::time_point initialized_;
+        bool first_balloon_;
+
+        const Descript &getOverride(int side, int id);
 
     public:
         Ai();
@@ -52,7 +70,8 @@ class Ai {
 
         void load();
 
-        std::string getInfo(int id, std::string key, std::string default_);
+        // side, idが-1なら全体の設定
+        const BalloonConfig *getBalloonConfig(int side, int id);
 
         void create(int side);
 
@@ -66,6 +85,7 @@ class Ai {
         std::optional<Offset> getCharacterOffset(int side);
 
         void setScale(int scale);
+        void setScrollback(int lines);
 
         void show(int side);
         void raise(int side);
@@ -88,6 +108,12 @@ class Ai {
         void raiseOnTalk(int side);
 
         void clearCache();
+        void reload();
+        // 拡大が終わった画像を使っているキャラクターだけ描き直させる
+        void upconverted(const std::filesystem::path &path);
+
+        void enqueueMotion(const SDL_MouseMotionEvent &event);
+        void dispatchMotion();
 
         operator bool() {
             return alive_;
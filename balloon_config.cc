@@ -0,0 +1,35 @@
+#include "balloon_config.h"
+
+#include "util.h"
+
+BalloonConfig::BalloonConfig(const Descript &base, const Descript &override) {
+    auto get = [&](const std::string &key, int default_) {
+        int value = default_;
+        if (override.contains(key) && !override.at(key).empty()) {
+            util::to_x(override.at(key), value);
+        }
+        else if (base.contains(key) && !base.at(key).empty()) {
+            util::to_x(base.at(key), value);
+        }
+        return value;
+    };
+    auto color = [&](const std::string &prefix) -> post::ColorInt {
+        return {get(prefix + ".r", 0), get(prefix + ".g", 0), get(prefix + ".b", 0), 0xff};
+    };
+    origin_x = get("origin.x", 0);
+    origin_y = get("origin.y", 0);
+    validrect_left = get("validrect.left", 0);
+    validrect_top = get("validrect.top", 0);
+    validrect_right = get("validrect.right", 0);
+    validrect_bottom = get("validrect.bottom", 0);
+    wordwrappoint_x = get("wordwrappoint.x", 0);
+    font_color = color("font.color");
+    disable_font_color = color("disable.font.color");
+    communicatebox = {
+        get("communicatebox.x", 0),
+        get("communicatebox.y", 0),
+        get("communicatebox.w", 200),
+        get("communicatebox.h", 20),
+    };
+    communicatebox_font_color = color("communicatebox.font.color");
+}
@@ -0,0 +1,29 @@
+#ifndef BALLOON_CONFIG_H_
+#define BALLOON_CONFIG_H_
+
+#include <string>
+#include <unordered_map>
+
+#include "misc.h"
+#include "post.h"
+
+using Descript = std::unordered_map<std::string, std::string>;
+
+// 吹き出し毎の設定
+// descriptは読み込み時に1度だけ解釈して、描画時は参照するだけにする
+// 位置の負の値は画像の右端/下端からの相対位置なので
+// 画像の大きさが決まったところで解決する
+struct BalloonConfig {
+    int origin_x, origin_y;
+    int validrect_left, validrect_top, validrect_right, validrect_bottom;
+    int wordwrappoint_x;
+    post::ColorInt font_color;
+    post::ColorInt disable_font_color;
+    Rect communicatebox;
+    post::ColorInt communicatebox_font_color;
+
+    // overrideに無いキーはbaseから引く
+    BalloonConfig(const Descript &base, const Descript &override);
+};
+
+#endif // BALLOON_CONFIG_H_
@@ -0,0 +1,161 @@
+#include "balloon_watcher.h"
+#include "misc.h"
+
+#include <chrono>
+#include <map>
+#include <set>
+#include <string>
+
+// inotifyはLinuxにしか無い
+#if defined(__linux__)
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif // Linux
+
+#include "logger.h"
+
+namespace {
+    // この間変更が無ければ書き込みが終わったとみなす
+    constexpr int kQuietInterval = 100;
+    // inotifyが無いところでファイルの更新時刻を見に行く間隔
+    constexpr int kPollInterval = 1000;
+
+    bool isDescript(const std::string &name) {
+        if (name == "descript.txt") {
+            return true;
+        }
+        // balloons0s.txtなどの個別設定
+        return name.starts_with("balloon") && name.ends_with("s.txt");
+    }
+
+    bool isImage(const std::string &name) {
+        return name.starts_with("balloon") && (name.ends_with(".png") || name.ends_with(".pna"));
+    }
+}
+
+BalloonWatcher::BalloonWatcher(const std::filesystem::path &dir, std::unique_ptr<ImageCache> &image_cache) : dir_(dir), image_cache_(image_cache), alive_(true), result_({false, {}}) {
+    th_ = std::make_unique<std::thread>([this]() {
+        watch();
+    });
+}
+
+BalloonWatcher::~BalloonWatcher() {
+    alive_ = false;
+    if (th_) {
+        th_->join();
+    }
+}
+
+bool BalloonWatcher::fetch(Result &result) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!result_.descript_changed && result_.images.empty()) {
+        return false;
+    }
+    result = std::move(result_);
+    result_ = {false, {}};
+    return true;
+}
+
+void BalloonWatcher::flush(std::set<std::string> &pending) {
+    // 静かになったところでまとめて読み直す
+    Result result = {false, {}};
+    std::set<std::filesystem::path> images;
+    for (auto &name : pending) {
+        if (isDescript(name)) {
+            result.descript_changed = true;
+        }
+        else if (isImage(name)) {
+            // pnaが変わったときも対応するpngを読み直す
+            std::filesystem::path path = dir_ / name;
+            path.replace_extension(".png");
+            images.emplace(path);
+        }
+    }
+    pending.clear();
+    for (auto &path : images) {
+        Logger::log("reload:", path.string());
+        result.images.emplace_back(path, image_cache_->load(path));
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    result_.descript_changed = result_.descript_changed || result.descript_changed;
+    for (auto &image : result.images) {
+        result_.images.push_back(std::move(image));
+    }
+}
+
+#if defined(__linux__)
+void BalloonWatcher::watch() {
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0) {
+        Logger::log("inotify_init1 failed");
+        return;
+    }
+    if (inotify_add_watch(fd, dir_.string().c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        Logger::log("inotify_add_watch failed:", dir_.string());
+        close(fd);
+        return;
+    }
+    std::set<std::string> pending;
+    alignas(struct inotify_event) char buffer[4096];
+    while (alive_) {
+        struct pollfd pfd = {fd, POLLIN, 0};
+        if (poll(&pfd, 1, kQuietInterval) > 0) {
+            ssize_t len;
+            while ((len = read(fd, buffer, sizeof(buffer))) > 0) {
+                for (char *p = buffer; p < buffer + len; ) {
+                    auto *event = reinterpret_cast<struct inotify_event *>(p);
+                    if (event->len > 0) {
+                        pending.emplace(event->name);
+                    }
+                    p += sizeof(struct inotify_event) + event->len;
+                }
+            }
+            continue;
+        }
+        if (pending.empty()) {
+            continue;
+        }
+        flush(pending);
+    }
+    close(fd);
+}
+#else
+void BalloonWatcher::watch() {
+    // 更新時刻を覚えておき、変わったものを次の周回で変化が無ければ読み直す
+    std::map<std::string, std::filesystem::file_time_type> mtime;
+    std::set<std::string> pending;
+    bool first = true;
+    while (alive_) {
+        bool changed = false;
+        std::error_code ec;
+        for (auto &entry : std::filesystem::directory_iterator(dir_, ec)) {
+            auto name = entry.path().filename().string();
+            if (!isDescript(name) && !isImage(name)) {
+                continue;
+            }
+            auto t = entry.last_write_time(ec);
+            if (ec) {
+                continue;
+            }
+            auto it = mtime.find(name);
+            if (it != mtime.end() && it->second == t) {
+                continue;
+            }
+            mtime[name] = t;
+            if (!first) {
+                pending.emplace(name);
+                changed = true;
+            }
+        }
+        first = false;
+        if (!changed && !pending.empty()) {
+            flush(pending);
+        }
+        // 終了を待たせないよう細かく区切って寝る
+        for (int i = 0; alive_ && i < kPollInterval / kQuietInterval; i++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(kQuietInterval));
+        }
+    }
+}
+#endif // Linux
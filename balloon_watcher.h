@@ -0,0 +1,43 @@
+#ifndef BALLOON_WATCHER_H_
+#define BALLOON_WATCHER_H_
+
+#include <atomic>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "image_cache.h"
+
+// 吹き出しのディレクトリを監視して、変更された画像を読み直しておく
+// 結果の反映はメインスレッドでfetchしてから行う
+class BalloonWatcher {
+    public:
+        struct Result {
+            bool descript_changed;
+            std::vector<std::pair<std::filesystem::path, std::optional<ImageInfo>>> images;
+        };
+    private:
+        std::filesystem::path dir_;
+        std::unique_ptr<ImageCache> &image_cache_;
+        std::atomic<bool> alive_;
+        std::mutex mutex_;
+        Result result_;
+        std::unique_ptr<std::thread> th_;
+
+        void watch();
+        // pendingのファイルを読み直してresult_に足す
+        void flush(std::set<std::string> &pending);
+    public:
+        BalloonWatcher(const std::filesystem::path &dir, std::unique_ptr<ImageCache> &image_cache);
+        ~BalloonWatcher();
+        // 前回から変更があればresultに入れてtrueを返す
+        bool fetch(Result &result);
+};
+
+#endif // BALLOON_WATCHER_H_
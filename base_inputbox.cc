@@ -1,29 +1,22 @@
 #include "base_inputbox.h"
 
 #include <cassert>
-#include <numeric>
+#include <string_view>
 
 #include <SDL3/SDL_render.h>
 #include <SDL3/SDL_stdinc.h>
 
 #include "ai.h"
 #include "logger.h"
+#include "utf8.h"
 #include "util.h"
 
 #define MOUSE_BUTTON_LEFT 1
 #define MOUSE_BUTTON_MIDDLE 2
 #define MOUSE_BUTTON_RIGHT 3
 
-BaseInputBox::BaseInputBox(Ai *parent, std::unique_ptr<FontCache> &font_cache) : alive_(true), changed_(true), cursor_index_(0), font_cache_(font_cache), parent_(parent) {
-    int r, g, b, a = 0xff;
-    std::string s;
-    s = parent_->getInfo(-1, "communicatebox.font.color.r", "0");
-    util::to_x(s, r);
-    s = parent_->getInfo(-1, "communicatebox.font.color.g", "0");
-    util::to_x(s, g);
-    s = parent_->getInfo(-1, "communicatebox.font.color.b", "0");
-    util::to_x(s, b);
-    color_ = {static_cast<Uint8>(r), static_cast<Uint8>(g), static_cast<Uint8>(b), static_cast<Uint8>(a)};
+BaseInputBox::BaseInputBox(Ai *parent, std::unique_ptr<FontCache> &font_cache) : window_(nullptr), renderer_(nullptr), alive_(true), changed_(true), cursor_(0), font_cache_(font_cache), parent_(parent) {
+    config_ = parent_->getBalloonConfig(-1, -1);
 }
 
 BaseInputBox::~BaseInputBox() {
@@ -35,55 +28,57 @@ BaseInputBox::~BaseInputBox() {
 }
 
 void BaseInputBox::init(std::unique_ptr<ImageCache> &image_cache) {
-    auto &info = image_cache->getRelative(filename());
+    auto info = image_cache->getRelative(filename());
+    int w = (info) ? (info->width()) : (200);
+    int h = (info) ? (info->height()) : (20);
+    window_ = SDL_CreateWindow(name().c_str(), w, h, SDL_WINDOW_TRANSPARENT | SDL_WINDOW_BORDERLESS | SDL_WINDOW_INPUT_FOCUS | SDL_WINDOW_MOUSE_FOCUS);
+    SDL_GetWindowPosition(window_, &x_, &y_);
+    renderer_ = SDL_CreateRenderer(window_, nullptr);
+    SDL_SetRenderVSync(renderer_, 1);
+    reload(image_cache);
+    SDL_PropertiesID p = SDL_CreateProperties();
+    // FIXME password, number, etc
+    SDL_SetNumberProperty(p, SDL_PROP_TEXTINPUT_TYPE_NUMBER, SDL_TEXTINPUT_TYPE_TEXT);
+    SDL_SetBooleanProperty(p, SDL_PROP_TEXTINPUT_MULTILINE_BOOLEAN, false);
+    SDL_StartTextInputWithProperties(window_, p);
+
+    editing_texture_ = std::make_unique<WrapTexture>(renderer_, 1, 1);
+    SDL_SetRenderTarget(renderer_, editing_texture_->texture());
+    SDL_SetRenderDrawColor(renderer_, 0xff, 0xff, 0xff, 0xff);
+    SDL_RenderClear(renderer_);
+    Logger::log("inputbox.init:", SDL_GetError(), window_);
+}
+
+void BaseInputBox::reload(std::unique_ptr<ImageCache> &image_cache) {
+    if (window_ == nullptr) {
+        return;
+    }
+    // BalloonConfigは中身だけ入れ替わるので読み直す
+    auto &c = config_->communicatebox_font_color;
+    color_ = {static_cast<Uint8>(c.r), static_cast<Uint8>(c.g), static_cast<Uint8>(c.b), static_cast<Uint8>(c.a)};
+    auto info = image_cache->getRelative(filename());
     if (info) {
-        window_ = SDL_CreateWindow(name().c_str(), info->width(), info->height(), SDL_WINDOW_TRANSPARENT | SDL_WINDOW_BORDERLESS | SDL_WINDOW_INPUT_FOCUS | SDL_WINDOW_MOUSE_FOCUS);
-        SDL_GetWindowPosition(window_, &x_, &y_);
-        renderer_ = SDL_CreateRenderer(window_, nullptr);
-        SDL_SetRenderVSync(renderer_, 1);
+        SDL_SetWindowSize(window_, info->width(), info->height());
         WrapSurface surface(info.value());
         texture_ = std::make_unique<WrapTexture>(renderer_, surface.surface(), surface.isUpconverted());
-        std::string s;
-        int x, y, w, h;
-        s = parent_->getInfo(-1, "communicatebox.x", "0");
-        util::to_x(s, x);
-        s = parent_->getInfo(-1, "communicatebox.y", "0");
-        util::to_x(s, y);
-        s = parent_->getInfo(-1, "communicatebox.w", "200");
-        util::to_x(s, w);
-        s = parent_->getInfo(-1, "communicatebox.h", "20");
-        util::to_x(s, h);
-        r_ = {x, y, w, h};
-        SDL_SetTextInputArea(window_, &r_, 0);
+        auto &box = config_->communicatebox;
+        r_ = {box.x, box.y, box.width, box.height};
     }
     else {
-        window_ = SDL_CreateWindow(name().c_str(), 200, 20, SDL_WINDOW_TRANSPARENT | SDL_WINDOW_BORDERLESS | SDL_WINDOW_INPUT_FOCUS | SDL_WINDOW_MOUSE_FOCUS);
-        SDL_GetWindowPosition(window_, &x_, &y_);
-        renderer_ = SDL_CreateRenderer(window_, nullptr);
-        SDL_SetRenderVSync(renderer_, 1);
+        SDL_SetWindowSize(window_, 200, 20);
         texture_ = std::make_unique<WrapTexture>(renderer_, 200, 20);
         SDL_SetRenderTarget(renderer_, texture_->texture());
         SDL_SetRenderDrawColor(renderer_, 0xff, 0xff, 0xff, 0xff);
         SDL_RenderClear(renderer_);
         r_ = {0, 0, 200, 20};
-        SDL_SetTextInputArea(window_, &r_, 0);
     }
-    SDL_PropertiesID p = SDL_CreateProperties();
-    // FIXME password, number, etc
-    SDL_SetNumberProperty(p, SDL_PROP_TEXTINPUT_TYPE_NUMBER, SDL_TEXTINPUT_TYPE_TEXT);
-    SDL_SetBooleanProperty(p, SDL_PROP_TEXTINPUT_MULTILINE_BOOLEAN, false);
-    SDL_StartTextInputWithProperties(window_, p);
+    SDL_SetTextInputArea(window_, &r_, 0);
 
     cursor_texture_ = std::make_unique<WrapTexture>(renderer_, 1, 1);
     SDL_SetRenderTarget(renderer_, cursor_texture_->texture());
     SDL_SetRenderDrawColor(renderer_, color_.r, color_.g, color_.b, color_.a);
     SDL_RenderClear(renderer_);
-
-    editing_texture_ = std::make_unique<WrapTexture>(renderer_, 1, 1);
-    SDL_SetRenderTarget(renderer_, editing_texture_->texture());
-    SDL_SetRenderDrawColor(renderer_, 0xff, 0xff, 0xff, 0xff);
-    SDL_RenderClear(renderer_);
-    Logger::log("inputbox.init:", SDL_GetError(), window_);
+    change();
 }
 
 bool BaseInputBox::alive() const {
@@ -104,28 +99,15 @@ void BaseInputBox::draw() {
     SDL_RenderTexture(renderer_, texture_->texture(), nullptr, nullptr);
     auto &font = font_cache_->get("default");
     int width = 0;
-    {
-        std::string str;
-        for (int i = 0; i < text_.size(); i++) {
-            if (i >= cursor_index_) {
-                break;
-            }
-            str += text_[i];
-        }
-        if (str.length() > 0) {
-            TTF_MeasureString(font->font(), str.data(), str.length(), 0, &width, nullptr);
-        }
+    if (cursor_ > 0) {
+        TTF_MeasureString(font->font(), text_.data(), cursor_, 0, &width, nullptr);
     }
     {
         SDL_FRect r = {r_.x + width, r_.y, 1, TTF_GetFontHeight(font->font())};
         SDL_RenderTexture(renderer_, cursor_texture_->texture(), nullptr, &r);
     }
     if (!text_.empty()) {
-        std::string str;
-        for (auto &s : text_) {
-            str += s;
-        }
-        SDL_Surface *surface = TTF_RenderText_Blended(font->font(), str.data(), str.length(), color_);
+        SDL_Surface *surface = TTF_RenderText_Blended(font->font(), text_.data(), text_.length(), color_);
         WrapTexture t(renderer_, surface, true);
         SDL_FRect r = {r_.x, r_.y, surface->w, surface->h};
         SDL_RenderTexture(renderer_, t.texture(), nullptr, &r);
@@ -170,24 +152,28 @@ void BaseInputBox::key(const SDL_KeyboardEvent &event) {
     }
     switch (event.key) {
         case SDLK_RETURN:
-            activate(std::accumulate(text_.begin(), text_.end(), std::string()));
+            activate(text_);
             change();
             break;
         case SDLK_ESCAPE:
             cancel();
             break;
         case SDLK_BACKSPACE:
-            if (text_.size() > 0 && cursor_index_ > 0) {
-                text_.erase(std::next(text_.begin(), --cursor_index_));
+            if (cursor_ > 0) {
+                size_t begin = utf8::prev(text_, cursor_);
+                text_.erase(begin, cursor_ - begin);
+                cursor_ = begin;
                 change();
             }
             break;
         case SDLK_RIGHT:
-            cursor_index_ = std::min(cursor_index_ + 1, static_cast<int>(text_.size()));
+            if (cursor_ < text_.length()) {
+                cursor_ += utf8::decode(text_, cursor_).length;
+            }
             change();
             break;
         case SDLK_LEFT:
-            cursor_index_ = std::max(cursor_index_ - 1, 0);
+            cursor_ = utf8::prev(text_, cursor_);
             change();
             break;
         default:
@@ -200,8 +186,20 @@ void BaseInputBox::input(const SDL_TextInputEvent &event) {
         return;
     }
     Logger::log("event.input", event.text);
-    for (auto &s : util::UTF8Split(event.text)) {
-        text_.insert(std::next(text_.begin(), cursor_index_++), s);
+    std::string_view text = event.text;
+    if (utf8::isValid(text)) {
+        text_.insert(cursor_, text);
+        cursor_ += text.length();
+    }
+    else {
+        // 不正なバイト列は捨てる
+        for (auto &cp : utf8::view(text)) {
+            if (!cp.valid) {
+                continue;
+            }
+            text_.insert(cursor_, text.substr(cp.offset, cp.length));
+            cursor_ += cp.length;
+        }
     }
     change();
 }
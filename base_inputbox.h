@@ -10,6 +10,7 @@
 #include <SDL3/SDL_render.h>
 #include <SDL3/SDL_video.h>
 
+#include "balloon_config.h"
 #include "logger.h"
 #include "texture.h"
 
@@ -23,8 +24,10 @@ class BaseInputBox {
         bool alive_, changed_;
         int x_, y_;
         SDL_Color color_;
-        std::vector<std::string> text_;
-        int cursor_index_;
+        const BalloonConfig *config_;
+        std::string text_;
+        // text_上のbyte位置、常に文字の先頭を指す
+        size_t cursor_;
         std::string editing_;
         std::optional<Offset> drag_;
         std::unique_ptr<WrapTexture> cursor_texture_;
@@ -37,6 +40,8 @@ class BaseInputBox {
         BaseInputBox(Ai *parent, std::unique_ptr<FontCache> &font_cache);
         virtual ~BaseInputBox();
         void init(std::unique_ptr<ImageCache> &image_cache);
+        // 吹き出しの設定や画像が変わったときに作り直す
+        void reload(std::unique_ptr<ImageCache> &image_cache);
 
         virtual std::string name() = 0;
         virtual std::filesystem::path filename() = 0;
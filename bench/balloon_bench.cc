@@ -0,0 +1,167 @@
+// 吹き出し画像を切り替えたときにメインスレッドが止まる時間の比較
+// g++ -O2 -std=c++20 -I .. -I ../include -I ../libfontlist/include $(pkg-config --cflags sdl3 sdl3-image sdl3-ttf) balloon_bench.cc ../image_cache.cc ../image_kernel.cc ../resample.cc ../thread_pool.cc ../disk_cache.cc ../logger.cc $(pkg-config --libs sdl3 sdl3-image) -o balloon_bench
+// ./balloon_bench <balloon[sk]<id>.pngのあるディレクトリ>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "image_cache.h"
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    constexpr auto kFrame = std::chrono::microseconds(16667);
+    // 吹き出しを切り替える間隔
+    constexpr int kFramesPerSwitch = 6;
+
+    double ms(Clock::duration d) {
+        return std::chrono::duration<double, std::milli>(d).count();
+    }
+
+    // ディスクキャッシュが空の状態から始める
+    void freshDiskCache(const std::filesystem::path &dir) {
+        std::error_code ec;
+        std::filesystem::remove_all(dir, ec);
+        std::filesystem::create_directories(dir, ec);
+        setenv("XDG_CACHE_HOME", dir.c_str(), 1);
+    }
+
+    struct Result {
+        // 1フレームの中でImageCacheに使った時間
+        std::vector<double> stall;
+        // 切り替えてから表示できるまで
+        std::vector<double> latency;
+    };
+
+    void report(const char *name, Result &r) {
+        std::sort(r.stall.begin(), r.stall.end());
+        std::sort(r.latency.begin(), r.latency.end());
+        double sum = 0;
+        for (auto v : r.stall) {
+            sum += v;
+        }
+        auto p = [](const std::vector<double> &v, double q) {
+            return v.empty() ? 0.0 : v[std::min(v.size() - 1, static_cast<size_t>(q * v.size()))];
+        };
+        size_t over = std::count_if(r.stall.begin(), r.stall.end(), [](double v) { return v > ms(kFrame); });
+        printf("%-10s stall/frame: max %7.2fms p99 %7.2fms total %8.2fms, frames over budget %zu/%zu | latency: median %7.2fms max %7.2fms\n",
+                name, r.stall.back(), p(r.stall, 0.99), sum, over, r.stall.size(), p(r.latency, 0.5), r.latency.back());
+    }
+
+    // 置き換える前と同じく、初めて使うときにメインスレッドでdecodeする
+    Result runSync(ImageCache &cache, const std::vector<std::filesystem::path> &paths) {
+        Result r;
+        for (auto &path : paths) {
+            for (int f = 0; f < kFramesPerSwitch; f++) {
+                auto begin = Clock::now();
+                if (f == 0) {
+                    cache.decode(path);
+                }
+                auto elapsed = Clock::now() - begin;
+                r.stall.push_back(ms(elapsed));
+                if (f == 0) {
+                    r.latency.push_back(ms(elapsed));
+                }
+                std::this_thread::sleep_for(kFrame - std::min<Clock::duration>(elapsed, kFrame));
+            }
+        }
+        return r;
+    }
+
+    // 読み込み中は前の画像のまま描き、readyになったら取り出す
+    Result runAsync(ImageCache &cache, const std::vector<std::filesystem::path> &paths) {
+        Result r;
+        size_t next = 0;
+        std::filesystem::path wanted;
+        Clock::time_point switched;
+        bool shown = true;
+        for (int frame = 0; next < paths.size() || !shown; frame++) {
+            auto begin = Clock::now();
+            if (frame % kFramesPerSwitch == 0 && next < paths.size()) {
+                if (!shown) {
+                    // 間に合わなかったものは表示されないまま次に移る
+                    r.latency.push_back(ms(begin - switched));
+                }
+                wanted = paths[next++];
+                switched = begin;
+                shown = false;
+            }
+            if (!shown && cache.ready(wanted)) {
+                cache.get(wanted);
+                shown = true;
+                r.latency.push_back(ms(Clock::now() - switched));
+            }
+            auto elapsed = Clock::now() - begin;
+            r.stall.push_back(ms(elapsed));
+            std::this_thread::sleep_for(kFrame - std::min<Clock::duration>(elapsed, kFrame));
+        }
+        return r;
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <balloon dir>\n", argv[0]);
+        return 1;
+    }
+    std::filesystem::path dir = argv[1];
+    std::vector<std::filesystem::path> paths;
+    for (auto &entry : std::filesystem::directory_iterator(dir)) {
+        auto name = entry.path().filename().string();
+        if (name.starts_with("balloon") && name.ends_with(".png") && (name[7] == 's' || name[7] == 'k')) {
+            paths.push_back(entry.path());
+        }
+    }
+    std::sort(paths.begin(), paths.end());
+    auto tmp = std::filesystem::temp_directory_path() / "ai_builtin_bench";
+    printf("%zu images, %u threads, switch every %d frames\n", paths.size(), std::thread::hardware_concurrency(), kFramesPerSwitch);
+
+    {
+        freshDiskCache(tmp);
+        ImageCache cache(dir, dir, false);
+        auto r = runSync(cache, paths);
+        report("sync", r);
+    }
+    {
+        freshDiskCache(tmp);
+        ImageCache cache(dir, dir, false);
+        auto r = runAsync(cache, paths);
+        report("async", r);
+    }
+    {
+        // Initialize直後に全て積んでおいた場合
+        freshDiskCache(tmp);
+        ImageCache cache(dir, dir, false);
+        cache.preload();
+        auto r = runAsync(cache, paths);
+        report("preload", r);
+    }
+    {
+        // 全て読み終えるまでの時間、1枚ずつと並列で
+        freshDiskCache(tmp);
+        ImageCache cache(dir, dir, false);
+        auto begin = Clock::now();
+        for (auto &path : paths) {
+            cache.decode(path);
+        }
+        double serial = ms(Clock::now() - begin);
+        begin = Clock::now();
+        std::vector<std::shared_future<void>> futures;
+        for (auto &path : paths) {
+            futures.push_back(cache.request(path));
+        }
+        for (auto &f : futures) {
+            f.wait();
+        }
+        printf("decode all: serial %.2fms, pool %.2fms\n", serial, ms(Clock::now() - begin));
+    }
+    std::error_code ec;
+    std::filesystem::remove_all(tmp, ec);
+    return 0;
+}
@@ -0,0 +1,118 @@
+// utf8::viewと以前のUTF8Splitの比較
+// g++ -O2 -std=c++20 -I .. utf8_bench.cc ../utf8.cc -o utf8_bench
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "utf8.h"
+
+namespace {
+    // 置き換える前のutil::UTF8Splitそのまま
+    std::vector<std::string> UTF8Split(const std::string str) {
+        std::vector<std::string> ret;
+        std::string buffer;
+        int remain = 0;
+        for (int i = 0; i < str.length(); i++, remain--) {
+            unsigned char c = static_cast<unsigned char>(str[i]);
+            if (c >= 0x00 && c < 0x80 && remain == 0) {
+                remain = 1;
+                buffer = c;
+                ret.push_back(buffer);
+                buffer.clear();
+            }
+            else if (c >= 0xc2 && c < 0xe0 && remain == 0) {
+                remain = 2;
+                buffer += c;
+            }
+            else if (c >= 0xe0 && c < 0xf0 && remain == 0) {
+                remain = 3;
+                buffer += c;
+            }
+            else if (c >= 0xf0 && c < 0xf5 && remain == 0) {
+                remain = 4;
+                buffer += c;
+            }
+            else if (c >= 0x80 && c < 0xc0 && remain > 0) {
+                buffer += c;
+                if (remain == 1) {
+                    ret.push_back(buffer);
+                    buffer.clear();
+                }
+            }
+            else {
+                remain = 1;
+            }
+        }
+        return ret;
+    }
+
+    // ASCIIとかなを交互に並べる、ascii_runとkana_runはそれぞれの文字数
+    std::string makeInput(size_t bytes, int ascii_run, int kana_run) {
+        const char *ascii = "Hello, world! \\n[half]";
+        const char *kana[] = {"あ", "い", "う", "え", "お", "カ", "キ", "ク", "ケ", "コ", "。", "、"};
+        std::string s;
+        int i = 0, j = 0;
+        while (s.length() < bytes) {
+            for (int k = 0; k < ascii_run; k++) {
+                s += ascii[i++ % 21];
+            }
+            for (int k = 0; k < kana_run; k++) {
+                s += kana[j++ % 12];
+            }
+        }
+        return s;
+    }
+
+    template<typename F>
+    double measure(int repeat, F &&f) {
+        // 1回目は捨てる
+        f();
+        auto begin = std::chrono::steady_clock::now();
+        for (int i = 0; i < repeat; i++) {
+            f();
+        }
+        auto end = std::chrono::steady_clock::now();
+        return std::chrono::duration<double, std::nano>(end - begin).count() / repeat;
+    }
+}
+
+int main() {
+    struct Case {
+        const char *name;
+        int ascii_run, kana_run;
+    };
+    Case cases[] = {
+        {"ascii only", 1, 0},
+        {"ascii 8 + kana 2", 8, 2},
+        {"ascii 2 + kana 8", 2, 8},
+        {"kana only", 0, 1},
+    };
+    size_t sizes[] = {64, 4096, 256 * 1024};
+    volatile size_t sink = 0;
+    printf("%-18s %8s %14s %14s %8s\n", "input", "bytes", "split ns/B", "view ns/B", "ratio");
+    for (auto &c : cases) {
+        for (auto size : sizes) {
+            auto input = makeInput(size, c.ascii_run, c.kana_run);
+            int repeat = std::max<size_t>(1, (64 * 1024 * 1024) / input.length() / 8);
+            // どちらも1文字ずつ取り出して先頭バイトを読む
+            double split = measure(repeat, [&]() {
+                size_t sum = 0;
+                for (auto &s : UTF8Split(input)) {
+                    sum += static_cast<unsigned char>(s[0]) + s.length();
+                }
+                sink = sink + sum;
+            });
+            double view = measure(repeat, [&]() {
+                size_t sum = 0;
+                for (auto &cp : utf8::view(input)) {
+                    sum += static_cast<unsigned char>(input[cp.offset]) + cp.length;
+                }
+                sink = sink + sum;
+            });
+            printf("%-18s %8zu %14.3f %14.3f %7.1fx\n", c.name, input.length(), split / input.length(), view / input.length(), split / view);
+        }
+    }
+    return 0;
+}
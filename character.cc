@@ -28,6 +28,13 @@ void Character::destroy(SDL_DisplayID id) {
 }
 
 void Character::draw() {
+    // 吹き出し画像の読み込みが終わるまでは前のフレームのままにする
+    if (!info_.ready()) {
+        for (auto &[_, v] : windows_) {
+            v->hold();
+        }
+        return;
+    }
     position_changed_ = false;
     current_surface_ = info_.getSurface();
     for (auto &[_, v] : windows_) {
@@ -54,6 +61,10 @@ void Character::setScale(int scale) {
     info_.setScale(scale);
 }
 
+void Character::setScrollback(int lines) {
+    info_.setScrollback(lines);
+}
+
 void Character::show() {
     info_.show();
     for (auto &[_, v] : windows_) {
@@ -87,6 +98,14 @@ void Character::clearCache() {
     }
 }
 
+bool Character::uses(const std::filesystem::path &path) const {
+    return info_.uses(path);
+}
+
+void Character::reload() {
+    info_.reload();
+}
+
 void Character::setSize(int w, int h) {
     std::unique_lock<std::mutex> lock(mutex_);
     if (rect_.width == w && rect_.height == h) {
@@ -155,7 +174,7 @@ void Character::enqueueDirectSSTP(std::vector<Request> list) {
     parent_->enqueueDirectSSTP(list);
 }
 
-Link Character::getLink() const {
+const Link &Character::getLink() const {
     return info_.getLink();
 }
 
@@ -195,8 +214,8 @@ void Character::hit(int x, int y) {
     info_.hit(x, y);
 }
 
-std::string Character::getInfo(int id, std::string key, std::string default_) {
-    return parent_->getInfo(id, key, default_);
+const BalloonConfig *Character::getBalloonConfig(int id) {
+    return parent_->getBalloonConfig(side_, id);
 }
 
 void Character::appendText(const std::string &text) {
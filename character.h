@@ -1,6 +1,7 @@
 #ifndef CHARACTER_H_
 #define CHARACTER_H_
 
+#include <filesystem>
 #include <memory>
 #include <optional>
 #include <vector>
@@ -44,16 +45,27 @@ class Character {
         void create(SDL_DisplayID display_id);
         void destroy(SDL_DisplayID display_id);
         void draw();
+        // 吹き出しを描いたことがあるか
+        bool drawn() const {
+            return static_cast<bool>(current_surface_);
+        }
         bool swapBuffers();
         int side() const {
             return side_;
         }
         void setScale(int scale);
+        void setScrollback(int lines);
         void show();
         void hide();
         void clearText(bool initialize);
         void setBalloonID(int id);
         void clearCache();
+        bool uses(const std::filesystem::path &path) const;
+        void reload();
+        // 次のフレームで描き直させる
+        void change() {
+            info_.change();
+        }
         Rect getRect() {
             Rect r;
             {
@@ -89,14 +101,14 @@ class Character {
         void resetPosition();
         std::string sendDirectSSTP(std::string method, std::string command, std::vector<std::string> args);
         void enqueueDirectSSTP(std::vector<Request> list);
-        Link getLink() const;
+        const Link &getLink() const;
         void motion(const SDL_MouseMotionEvent &event);
         void button(const SDL_MouseButtonEvent &event);
         void wheel(const SDL_MouseWheelEvent &event);
         void scroll(int diff);
         void maximized(const SDL_WindowEvent &event);
         void hit(int x, int y);
-        std::string getInfo(int id, std::string key, std::string default_);
+        const BalloonConfig *getBalloonConfig(int id);
         void appendText(const std::string &text);
         void appendLinkBegin(bool is_anchor, const std::string &event, const std::vector<std::string> &args);
         void appendLinkEnd();
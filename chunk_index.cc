@@ -0,0 +1,59 @@
+#include "chunk_index.h"
+
+#include <algorithm>
+#include <climits>
+
+void ChunkIndex::update(const post::Post &post) {
+    if (post.empty()) {
+        return;
+    }
+    for (; indexed_ + 1 < post.size(); indexed_++) {
+        auto &p = post.position[indexed_];
+        Entry e = {p.y, p.y + p.h, 0, indexed_};
+        // 大抵は末尾に追加するだけで済む
+        auto it = std::upper_bound(entries_.begin(), entries_.end(), e.top, [](int top, const Entry &e) {
+            return top < e.top;
+        });
+        size_t pos = it - entries_.begin();
+        entries_.insert(it, e);
+        for (size_t i = pos; i < entries_.size(); i++) {
+            int prev = (i > 0) ? (entries_[i - 1].max_bottom) : (INT_MIN);
+            entries_[i].max_bottom = std::max(prev, entries_[i].bottom);
+        }
+    }
+}
+
+void ChunkIndex::find(const post::Post &post, int top, int bottom, std::vector<size_t> &list) const {
+    list.clear();
+    auto it = std::lower_bound(entries_.begin(), entries_.end(), bottom, [](const Entry &e, int bottom) {
+        return e.top < bottom;
+    });
+    while (it != entries_.begin()) {
+        --it;
+        if (it->max_bottom <= top) {
+            break;
+        }
+        if (it->bottom > top) {
+            list.push_back(it->index);
+        }
+    }
+    // 最後のchunkは索引に含まれない
+    if (!post.empty() && indexed_ < post.size()) {
+        for (size_t i = indexed_; i < post.size(); i++) {
+            auto &p = post.position[i];
+            if (p.y < bottom && p.y + p.h > top) {
+                list.push_back(i);
+            }
+        }
+    }
+    std::sort(list.begin(), list.end());
+}
+
+int ChunkIndex::bottom(const post::Post &post) const {
+    int bottom = (entries_.empty()) ? (0) : (entries_.back().max_bottom);
+    for (size_t i = indexed_; i < post.size(); i++) {
+        auto &p = post.position[i];
+        bottom = std::max(bottom, p.y + p.h);
+    }
+    return bottom;
+}
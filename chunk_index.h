@@ -0,0 +1,37 @@
+#ifndef CHUNK_INDEX_H_
+#define CHUNK_INDEX_H_
+
+#include <cstddef>
+#include <vector>
+
+#include "post.h"
+
+// chunkを縦方向の範囲で引くための索引
+// 最後のchunk以外は後から変化しないので、それらだけを順に加えていく
+// chunkを消したり作り直したときはclearすること
+class ChunkIndex {
+    struct Entry {
+        int top, bottom;
+        // この要素までのbottomの最大値
+        int max_bottom;
+        size_t index;
+    };
+    private:
+        // topの昇順
+        std::vector<Entry> entries_;
+        size_t indexed_;
+    public:
+        ChunkIndex() : indexed_(0) {}
+        ~ChunkIndex() {}
+        void clear() {
+            entries_.clear();
+            indexed_ = 0;
+        }
+        void update(const post::Post &post);
+        // [top, bottom)と重なるchunkのindexを昇順でlistに入れる
+        void find(const post::Post &post, int top, int bottom, std::vector<size_t> &list) const;
+        // 全chunkの下端の最大値
+        int bottom(const post::Post &post) const;
+};
+
+#endif // CHUNK_INDEX_H_
@@ -0,0 +1,121 @@
+#include "conv.h"
+
+#include <algorithm>
+#include <cctype>
+#include <mutex>
+#include <unordered_map>
+
+#include <SDL3/SDL_stdinc.h>
+
+#include "logger.h"
+#include "utf8.h"
+
+namespace {
+    // iconvの変換記述子は状態を持つので
+    // 使っている間はpoolから外しておく
+    std::mutex mutex;
+    std::unordered_multimap<std::string, SDL_iconv_t> pool;
+
+    std::string normalize(const std::string &charset) {
+        std::string ret;
+        for (auto c : charset) {
+            if (c == '-' || c == '_') {
+                continue;
+            }
+            ret.push_back(std::toupper(static_cast<unsigned char>(c)));
+        }
+        return ret;
+    }
+
+    // ASCIIの範囲がそのままの値で表される文字コードか
+    bool isASCIICompatible(const std::string &charset) {
+        auto c = normalize(charset);
+        return !c.starts_with("UTF16") && !c.starts_with("UTF32") &&
+            !c.starts_with("UCS");
+    }
+
+    SDL_iconv_t acquire(const std::string &key, const std::string &to, const std::string &from) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            auto it = pool.find(key);
+            if (it != pool.end()) {
+                auto cd = it->second;
+                pool.erase(it);
+                // 前回の状態を消す
+                SDL_iconv(cd, nullptr, nullptr, nullptr, nullptr);
+                return cd;
+            }
+        }
+        return SDL_iconv_open(to.c_str(), from.c_str());
+    }
+
+    void release(const std::string &key, SDL_iconv_t cd) {
+        std::unique_lock<std::mutex> lock(mutex);
+        pool.emplace(key, cd);
+    }
+}
+
+bool isUTF8(const std::string &charset) {
+    return normalize(charset) == "UTF8";
+}
+
+std::string conv(const std::string &src, const std::string &to, const std::string &from) {
+    if (src.empty() || normalize(to) == normalize(from)) {
+        return src;
+    }
+    if (isASCIICompatible(to) && isASCIICompatible(from) &&
+            utf8::skipASCII(src, 0) == src.length()) {
+        return src;
+    }
+    std::string key = to + '\n' + from;
+    SDL_iconv_t cd = acquire(key, to, from);
+    if (cd == reinterpret_cast<SDL_iconv_t>(SDL_ICONV_ERROR)) {
+        Logger::log("iconv_open error:", from, "=>", to);
+        return src;
+    }
+    std::string dest;
+    dest.resize(src.length() + src.length() / 2 + 16);
+    const char *in = src.data();
+    size_t in_length = src.length();
+    size_t written = 0;
+    // 足りなくなったら広げて続きから変換する
+    auto convert = [&](const char **in, size_t *in_length) {
+        while (true) {
+            char *out = dest.data() + written;
+            size_t out_length = dest.length() - written;
+            size_t ret = SDL_iconv(cd, in, in_length, &out, &out_length);
+            written = out - dest.data();
+            if (ret == SDL_ICONV_E2BIG) {
+                dest.resize(dest.length() * 2);
+                continue;
+            }
+            return ret;
+        }
+    };
+    while (in_length > 0) {
+        size_t ret = convert(&in, &in_length);
+        if (ret == SDL_ICONV_EILSEQ) {
+            // 不正な1byteを飛ばして続ける
+            if (written == dest.length()) {
+                dest.resize(dest.length() * 2);
+            }
+            dest[written++] = '?';
+            in++;
+            in_length--;
+        }
+        else if (ret == SDL_ICONV_EINVAL) {
+            // 末尾が途中で切れている
+            break;
+        }
+        else if (ret == SDL_ICONV_ERROR) {
+            Logger::log("iconv error:", from, "=>", to);
+            release(key, cd);
+            return src;
+        }
+    }
+    // 状態を持つ文字コードの終端処理
+    convert(nullptr, nullptr);
+    release(key, cd);
+    dest.resize(written);
+    return dest;
+}
@@ -3,6 +3,10 @@
 
 #include <string>
 
-std::string conv(std::string src, std::string to, std::string from);
+// fromからtoに変換する、変換できない文字は?に置き換える
+// 変換自体ができなければsrcをそのまま返す
+std::string conv(const std::string &src, const std::string &to, const std::string &from);
+
+bool isUTF8(const std::string &charset);
 
 #endif // CONV_H_
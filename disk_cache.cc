@@ -0,0 +1,230 @@
+#include "disk_cache.h"
+#include "misc.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if defined(IS__NIX)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif // Linux
+
+#include "logger.h"
+
+namespace {
+    constexpr char kMagic[8] = {'A', 'I', 'B', 'I', 'M', 'G', '\0', '\0'};
+    constexpr uint32_t kFormatVersion = 1;
+    // 画素の先頭の位置を揃えておく
+    constexpr uint64_t kAlignment = 64;
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        int32_t width, height;
+        uint32_t key_length;
+        uint64_t data_offset;
+    };
+
+#if defined(IS__NIX)
+    struct Mapping {
+        void *addr;
+        size_t length;
+        ~Mapping() {
+            munmap(addr, length);
+        }
+    };
+#endif // Linux
+}
+
+DiskCache::DiskCache(uint64_t budget) : enabled_(false), budget_(budget), used_(0) {
+#if defined(IS__NIX)
+    const char *xdg = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    if (xdg != nullptr && xdg[0] != '\0') {
+        dir_ = xdg;
+    }
+    else if (home != nullptr && home[0] != '\0') {
+        dir_ = std::filesystem::path(home) / ".cache";
+    }
+    else {
+        return;
+    }
+    dir_ /= "ai_builtin";
+    std::error_code ec;
+    std::filesystem::create_directories(dir_, ec);
+    enabled_ = !ec;
+    if (enabled_) {
+        prune();
+    }
+#endif // Linux
+}
+
+void DiskCache::prune() const {
+    std::unique_lock<std::mutex> lock(prune_mutex_);
+    std::vector<std::pair<std::filesystem::file_time_type, std::filesystem::path>> list;
+    uint64_t used = 0;
+    std::error_code ec;
+    for (auto &entry : std::filesystem::directory_iterator(dir_, ec)) {
+        if (entry.path().extension() != ".img") {
+            continue;
+        }
+        auto size = entry.file_size(ec);
+        if (ec) {
+            continue;
+        }
+        auto mtime = entry.last_write_time(ec);
+        if (ec) {
+            continue;
+        }
+        used += size;
+        list.emplace_back(mtime, entry.path());
+    }
+    if (used > budget_) {
+        // 使った時に更新時刻を進めているので古いものほど使われていない
+        std::sort(list.begin(), list.end());
+        for (auto &[_, path] : list) {
+            if (used <= budget_) {
+                break;
+            }
+            auto size = std::filesystem::file_size(path, ec);
+            if (ec) {
+                continue;
+            }
+            // mmapされているものは消しても読み続けられる
+            if (std::filesystem::remove(path, ec)) {
+                used -= size;
+                Logger::log("disk cache: pruned", path.string(), size, "bytes");
+            }
+        }
+    }
+    used_ = used;
+}
+
+uint64_t DiskCache::hash(std::string_view data) {
+    // FNV-1a
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (auto c : data) {
+        h ^= static_cast<unsigned char>(c);
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+std::filesystem::path DiskCache::filename(const std::string &key) const {
+    std::ostringstream oss;
+    oss << std::hex << hash(key) << ".img";
+    return dir_ / oss.str();
+}
+
+std::optional<ImageInfo> DiskCache::load(const std::string &key) const {
+#if defined(IS__NIX)
+    if (!enabled_ || key.empty()) {
+        return std::nullopt;
+    }
+    auto path = filename(key);
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return std::nullopt;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || static_cast<size_t>(st.st_size) < sizeof(Header)) {
+        close(fd);
+        return std::nullopt;
+    }
+    size_t length = st.st_size;
+    void *addr = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        return std::nullopt;
+    }
+    auto mapping = std::make_shared<const Mapping>(addr, length);
+    const unsigned char *p = static_cast<const unsigned char *>(addr);
+    Header header;
+    memcpy(&header, p, sizeof(header));
+    if (memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kFormatVersion) {
+        return std::nullopt;
+    }
+    if (header.width <= 0 || header.height <= 0 || header.key_length != key.length() ||
+            sizeof(Header) + header.key_length > header.data_offset) {
+        return std::nullopt;
+    }
+    size_t size = 4 * static_cast<size_t>(header.width) * header.height;
+    if (header.data_offset + size > length) {
+        return std::nullopt;
+    }
+    // ハッシュの衝突に備えてキーも比べる
+    if (memcmp(p + sizeof(Header), key.data(), key.length()) != 0) {
+        return std::nullopt;
+    }
+    // 古いものから消すので使ったものは新しくする
+    std::error_code ec;
+    std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), ec);
+    return ImageInfo(std::make_shared<const ImageBuffer>(mapping, p + header.data_offset, header.width, header.height), true);
+#else
+    return std::nullopt;
+#endif // Linux
+}
+
+void DiskCache::store(const std::string &key, const ImageInfo &info) const {
+#if defined(IS__NIX)
+    if (!enabled_ || key.empty()) {
+        return;
+    }
+    Header header = {};
+    memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kFormatVersion;
+    header.width = info.width();
+    header.height = info.height();
+    header.key_length = key.length();
+    header.data_offset = (sizeof(Header) + key.length() + kAlignment - 1) / kAlignment * kAlignment;
+    // 書き終わってからrenameして、読む側が途中のものを見ないようにする
+    static std::atomic<uint64_t> counter = 0;
+    auto path = filename(key);
+    auto tmp = path;
+    std::ostringstream oss;
+    oss << "." << getpid() << "." << counter++ << ".tmp";
+    tmp += oss.str();
+    {
+        std::ofstream ofs(tmp, std::ios_base::binary);
+        if (!ofs) {
+            return;
+        }
+        ofs.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        ofs.write(key.data(), key.length());
+        std::string padding(header.data_offset - sizeof(header) - key.length(), '\0');
+        ofs.write(padding.data(), padding.length());
+        ofs.write(reinterpret_cast<const char *>(info.data()), info.size());
+        if (!ofs) {
+            ofs.close();
+            std::error_code ec;
+            std::filesystem::remove(tmp, ec);
+            return;
+        }
+    }
+    std::error_code ec;
+    // 置き換えるものの大きさは差し引く
+    auto old_size = std::filesystem::file_size(path, ec);
+    if (ec) {
+        old_size = 0;
+    }
+    std::filesystem::rename(tmp, path, ec);
+    if (ec) {
+        Logger::log("disk cache: failed to store", path.string());
+        std::filesystem::remove(tmp, ec);
+        return;
+    }
+    uint64_t size = header.data_offset + info.size();
+    if (used_.fetch_add(size - old_size) + size - old_size > budget_) {
+        prune();
+    }
+#endif // Linux
+}
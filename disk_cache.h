@@ -0,0 +1,38 @@
+#ifndef DISK_CACHE_H_
+#define DISK_CACHE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "image_info.h"
+
+// 前処理済みの画像をファイルに保存しておき、次からはmmapして使う
+// 読み込んだImageInfoはmappingを直接参照する
+// キーには入力元のファイルの情報など結果に影響するものを全て含めること
+// 合計がbudgetを超えたら古いものから消す
+class DiskCache {
+    public:
+        static constexpr uint64_t kDefaultBudget = 512ull * 1024 * 1024;
+    private:
+        std::filesystem::path dir_;
+        bool enabled_;
+        uint64_t budget_;
+        // ディレクトリ内のキャッシュの合計、storeで増やしpruneで数え直す
+        mutable std::atomic<uint64_t> used_;
+        mutable std::mutex prune_mutex_;
+        std::filesystem::path filename(const std::string &key) const;
+        void prune() const;
+    public:
+        DiskCache(uint64_t budget = kDefaultBudget);
+        ~DiskCache() {}
+        std::optional<ImageInfo> load(const std::string &key) const;
+        void store(const std::string &key, const ImageInfo &info) const;
+        static uint64_t hash(std::string_view data);
+};
+
+#endif // DISK_CACHE_H_
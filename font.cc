@@ -1,6 +1,52 @@
 #include "font.h"
 
 #include "logger.h"
+#include "utf8.h"
+
+FontMetrics::FontMetrics(TTF_Font *font) : font_(font), height_(0), em_width_(0) {
+    if (font_ == nullptr) {
+        return;
+    }
+    height_ = TTF_GetFontHeight(font_);
+    TTF_MeasureString(font_, "0", 1, 0, &em_width_, nullptr);
+}
+
+int FontMetrics::advance(char32_t c) {
+    if (advance_.contains(c)) {
+        return advance_.at(c);
+    }
+    int advance = 0;
+    if (font_ != nullptr && !TTF_GetGlyphMetrics(font_, c, nullptr, nullptr, nullptr, nullptr, &advance)) {
+        advance = 0;
+    }
+    advance_[c] = advance;
+    return advance;
+}
+
+int FontMetrics::kerning(char32_t prev, char32_t c) {
+    if (prev == 0) {
+        return 0;
+    }
+    uint64_t key = (static_cast<uint64_t>(prev) << 32) | c;
+    if (kerning_.contains(key)) {
+        return kerning_.at(key);
+    }
+    int kerning = 0;
+    if (font_ != nullptr && !TTF_GetGlyphKerning(font_, prev, c, &kerning)) {
+        kerning = 0;
+    }
+    kerning_[key] = kerning;
+    return kerning;
+}
+
+int FontMetrics::measure(std::string_view text, char32_t prev) {
+    int width = 0;
+    for (auto &cp : utf8::view(text)) {
+        width += kerning(prev, cp.code) + advance(cp.code);
+        prev = cp.code;
+    }
+    return width;
+}
 
 WrapFont::WrapFont(const fontlist::fontfamily &family) : name_(family.name) {
     fontlist::font font = family.fonts[0];
@@ -16,11 +62,13 @@ WrapFont::WrapFont(const fontlist::fontfamily &family) : name_(family.name) {
     }
     font_ = TTF_OpenFont(font.file.string().c_str(), font.size);
     //TTF_SetFontSizeDPI(font_, font.size, 96, 96);
+    metrics_ = std::make_unique<FontMetrics>(font_);
 }
 
 WrapFont::WrapFont(const std::filesystem::path &path) : name_("") {
     // FIXME font pt size
     font_ = TTF_OpenFont(path.string().c_str(), 12);
+    metrics_ = std::make_unique<FontMetrics>(font_);
 }
 
 WrapFont::~WrapFont() {
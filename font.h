@@ -1,23 +1,55 @@
 #ifndef FONT_H_
 #define FONT_H_
 
+#include <cstdint>
 #include <filesystem>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 
 #include <SDL3_ttf/SDL_ttf.h>
 
 #include "fontlist.hpp"
 
+// グリフの送り幅とカーニングをフォント毎にキャッシュする
+// TTF_SetFontSizeで一時的にサイズを変えている間は使わないこと
+class FontMetrics {
+    private:
+        TTF_Font *font_;
+        int height_;
+        int em_width_;
+        std::unordered_map<char32_t, int> advance_;
+        std::unordered_map<uint64_t, int> kerning_;
+    public:
+        FontMetrics(TTF_Font *font);
+        ~FontMetrics() {}
+        int height() const {
+            return height_;
+        }
+        int emWidth() const {
+            return em_width_;
+        }
+        int advance(char32_t c);
+        int kerning(char32_t prev, char32_t c);
+        // prevの直後にtextを置いたときの幅
+        int measure(std::string_view text, char32_t prev = 0);
+};
+
 class WrapFont {
     private:
         TTF_Font *font_;
         std::string name_;
         float size_;
+        std::unique_ptr<FontMetrics> metrics_;
     public:
         WrapFont(const fontlist::fontfamily &family);
         WrapFont(const std::filesystem::path &path);
         ~WrapFont();
         TTF_Font *font();
+        FontMetrics &metrics() {
+            return *metrics_;
+        }
         std::string name() const {
             return name_;
         }
@@ -1,5 +1,14 @@
 #include "font_cache.h"
 
+namespace {
+    // 最初の表示で測ることになる文字
+    constexpr std::pair<char32_t, char32_t> kWarmRange[] = {
+        {0x3001, 0x3002}, // 、。
+        {0x3041, 0x3096}, // ひらがな
+        {0x30a1, 0x30fc}, // カタカナ、ー
+    };
+}
+
 FontCache::FontCache() {
     std::unique_ptr<WrapFont> invalid;
     cache_["invalid"] = std::move(invalid);
@@ -11,6 +20,12 @@ FontCache::~FontCache() {
 
 void FontCache::setDefaultFont(const fontlist::fontfamily &family) {
     cache_["default"] = std::make_unique<WrapFont>(family);
+    auto &metrics = cache_.at("default")->metrics();
+    for (auto [first, last] : kWarmRange) {
+        for (char32_t c = first; c <= last; c++) {
+            metrics.advance(c);
+        }
+    }
 }
 
 std::unique_ptr<WrapFont> &FontCache::getDefaultFont() {
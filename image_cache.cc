@@ -1,105 +1,237 @@
 #include "image_cache.h"
 #include "misc.h"
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <sstream>
 
+#include <SDL3/SDL_events.h>
 #include <SDL3_image/SDL_image.h>
 
+#include "image_kernel.h"
 #include "logger.h"
+#include "resample.h"
 #include "texture.h"
 
+namespace {
+    // decodeの処理を変えたら上げる、古いディスクキャッシュは使われなくなる
+    constexpr int kPreprocessVersion = 1;
+
+    // 8bitのグレースケールとして読む、大きさが違うか変換できなければ空
+    // 値は赤の成分を使う
+    std::vector<unsigned char> loadGray(const std::filesystem::path &path, int w, int h) {
+        std::vector<unsigned char> gray;
+        SDL_Surface *in = IMG_Load(path.string().c_str());
+        if (in == nullptr) {
+            return gray;
+        }
+        if (in->w != w || in->h != h) {
+            SDL_DestroySurface(in);
+            return gray;
+        }
+        gray.resize(w * h);
+        SDL_LockSurface(in);
+        const unsigned char *p = static_cast<const unsigned char *>(in->pixels);
+        SDL_Palette *palette = SDL_GetSurfacePalette(in);
+        if (in->format == SDL_PIXELFORMAT_INDEX8 && palette != nullptr) {
+            unsigned char table[256] = {};
+            for (int i = 0; i < palette->ncolors && i < 256; i++) {
+                table[i] = palette->colors[i].r;
+            }
+            for (int y = 0; y < h; y++) {
+                for (int x = 0; x < w; x++) {
+                    gray[y * w + x] = table[p[y * in->pitch + x]];
+                }
+            }
+        }
+        else {
+            // 1行ずつ変換して全体の変換結果は持たない
+            std::vector<unsigned char> row(4 * w);
+            for (int y = 0; y < h; y++) {
+                // 変換できない形式なら使わない
+                if (!SDL_ConvertPixels(w, 1, in->format, p + y * in->pitch, in->pitch, SDL_PIXELFORMAT_ABGR8888, row.data(), 4 * w)) {
+                    gray.clear();
+                    break;
+                }
+                for (int x = 0; x < w; x++) {
+                    gray[y * w + x] = row[4 * x];
+                }
+            }
+        }
+        SDL_UnlockSurface(in);
+        SDL_DestroySurface(in);
+        return gray;
+    }
+
+    // balloon[sk]<id>.pngの向き違い、吹き出し画像でなければ空
+    std::filesystem::path directionVariant(const std::filesystem::path &path) {
+        auto name = path.filename().string();
+        if (name.length() < 13 || !name.starts_with("balloon") || !name.ends_with(".png")) {
+            return {};
+        }
+        char kind = name[7];
+        if (kind != 's' && kind != 'k') {
+            return {};
+        }
+        auto digits = name.substr(8, name.length() - 12);
+        if (digits.find_first_not_of("0123456789") != std::string::npos) {
+            return {};
+        }
+        // 向きは吹き出しidの最下位bit
+        int id = std::stoi(digits) ^ 1;
+        return path.parent_path() / ("balloon" + std::string(1, kind) + std::to_string(id) + ".png");
+    }
+}
+
 #if defined(USE_ONNX)
 ImageCache::ImageCache(const std::filesystem::path &balloon_dir, const std::filesystem::path &exe_dir, bool use_self_alpha)
-    : balloon_dir_(balloon_dir), alive_(true), use_self_alpha_(use_self_alpha), scale_(100), session_(nullptr) {
+    : balloon_dir_(balloon_dir), alive_(true), use_self_alpha_(use_self_alpha), scale_(100), filter_(resample::Filter::Lanczos3), next_seq_(0), epoch_(0), event_type_(0), budget_(kDefaultBudget), used_(0), evictions_(0), evicted_bytes_(0), pool_(std::make_unique<ThreadPool>()) {
     std::filesystem::path model_path = exe_dir / "model.onnx";
     try {
-        Ort::SessionOptions session_options;
-        session_options.SetIntraOpNumThreads(1);
-#if defined(IS_WINDOWS)
-        session_ = {env_, model_path.wstring().c_str(), session_options};
-#else
-        session_ = {env_, model_path.string().c_str(), session_options};
-#endif // Windows
+        int num_threads = 0;
+        const char *threads = getenv("AI_BUILTIN_ONNX_THREADS");
+        if (threads != nullptr) {
+            num_threads = atoi(threads);
+        }
+        // 1ならpremultipliedなRGBだけをモデルに通す
+        bool premultiplied = false;
+        const char *layout = getenv("AI_BUILTIN_ONNX_PREMULTIPLIED");
+        if (layout != nullptr) {
+            premultiplied = atoi(layout) != 0;
+        }
+        upscaler_ = std::make_unique<Upscaler>(model_path, num_threads, premultiplied);
+        {
+            std::ifstream ifs(model_path, std::ios_base::binary);
+            std::string model((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+            std::ostringstream oss;
+            // 通し方が違えば結果も違う
+            oss << std::hex << DiskCache::hash(model) << ((premultiplied) ? ("p") : (""));
+            model_hash_ = oss.str();
+        }
+        event_type_ = SDL_RegisterEvents(1);
         th_ = std::make_unique<std::thread>([&]() {
             while (true) {
                 std::filesystem::path p;
                 int scale;
+                unsigned int epoch;
+                unsigned int generation = 0;
+                // 元画像を取るときに決めておかないと、変換中に変わったファイルのキーで保存してしまう
+                std::string key;
+                // 元画像はロックしている間に参照を取っておく
+                // 画素は共有されるのでcache_orig_が書き換わっても読み続けられる
+                std::optional<ImageInfo> info;
                 {
                     std::unique_lock<std::mutex> lock(mutex_);
-                    cond_.wait(lock, [&]() { return !queue_.empty(); });
-                    p = queue_.front();
-                    queue_.pop();
+                    cond_.wait(lock, [&]() { return !queue_.empty() || !alive_; });
+                    if (!alive_) {
+                        break;
+                    }
+                    p = *popQueue();
                     scale = scale_;
+                    epoch = epoch_;
+                    if (generation_.contains(p)) {
+                        generation = generation_.at(p);
+                    }
+                    if (cache_orig_.contains(p)) {
+                        info = cache_orig_.at(p);
+                        touch(0, p);
+                        key = cacheKey(p, scale);
+                        converting_ = p;
+                    }
+                    else if (scale == scale_ && cache_.contains(p)) {
+                        // 元画像が追い出されていたら次のgetで作り直させる
+                        cache_.erase(p);
+                        forget(scale, p);
+                    }
+                }
+                if (!info) {
+                    continue;
                 }
-                int num_resize = std::ceil(std::log2(scale_ / 100.0));
-                auto &info = cache_orig_.at(p);
+                int num_resize = std::ceil(std::log2(scale / 100.0));
                 int w = info->width();
                 int h = info->height();
-                std::vector<unsigned char> src;
-                std::vector<unsigned char> dest = info->get();
+                // 1回目は元画像を直接読み、以降は前の結果を読む
+                const unsigned char *src = info->data();
+                std::vector<unsigned char> prev;
+                bool failed = false;
+                bool cancelled = false;
+                auto is_cancelled = [&]() {
+                    return epoch_ != epoch;
+                };
                 for (int i = 0; i < num_resize; i++, w <<= 1, h <<= 1) {
-                    src = dest;
-                    dest.resize(src.size() * 4);
-                    std::array<int64_t, 4> input_shape = {4, 1, h, w};
-                    std::array<int64_t, 4> output_shape = {4, 1, 2 * h, 2 * w};
-                    std::vector<float> input;
-                    input.resize(src.size());
-                    std::vector<float> output;
-                    output.resize(dest.size());
-                    for (int i = 0; i < w * h; i++) {
-                        for (int c = 0; c < 4; c++) {
-                            input[c * w * h + i] = src[4 * i + c] / 255.0;
-                        }
-                    }
-                    auto mem_info = Ort::MemoryInfo::CreateCpu(OrtDeviceAllocator, OrtMemTypeCPU);
-                    Ort::Value input_tensor = Ort::Value::CreateTensor<float>(mem_info, input.data(), input.size(), input_shape.data(), input_shape.size());
-                    Ort::Value output_tensor = Ort::Value::CreateTensor<float>(mem_info, output.data(), output.size(), output_shape.data(), output_shape.size());
-                    const char *input_names[] = {"input"};
-                    const char *output_names[] = {"output"};
-                    Ort::RunOptions run_options;
                     try {
-                        session_.Run(run_options, input_names, &input_tensor, 1, output_names, &output_tensor, 1);
+                        prev = upscaler_->upscale(src, w, h, is_cancelled);
                     }
                     catch (Ort::Exception &e) {
                         Logger::log(e.what());
-                        auto &tmp = cache_.at(p);
-                        cache_[p] = {tmp->get(), tmp->width(), tmp->height(), true};
+                        failed = true;
+                        break;
                     }
-                    for (int i = 0; i < (2 * w) * (2 * h); i++) {
-                        for (int c = 0; c < 4; c++) {
-                            int byte = std::round(output[c * (2 * w) * (2 * h) + i] * 255);
-                            dest[4 * i + c] = std::max(0, std::min(255, byte));
-                        }
+                    if (prev.empty()) {
+                        cancelled = true;
+                        break;
                     }
+                    src = prev.data();
                 }
-                if (info->width() * scale_ / 100.0 != w) {
-                    int w_resize = std::round(info->width() * scale_ / 100.0);
-                    int h_resize = std::round(info->height() * scale_ / 100.0);
-                    std::vector<unsigned char> resize;
-                    resize.resize(w_resize * h_resize * 4);
-
-                    SDL_Surface *in = SDL_CreateSurfaceFrom(w, h, SDL_PIXELFORMAT_ABGR8888, dest.data(), w * 4);
-                    SDL_Surface *out = SDL_CreateSurface(w_resize, h_resize, SDL_PIXELFORMAT_ABGR8888);
-                    SDL_ClearSurface(out, 0, 0, 0, 0);
-                    SDL_BlitSurfaceScaled(in, nullptr, out, nullptr, SDL_SCALEMODE_LINEAR);
-                    SDL_LockSurface(out);
-                    memcpy(resize.data(), out->pixels, sizeof(unsigned char) * w_resize * h_resize * 4);
-                    SDL_UnlockSurface(out);
-                    SDL_DestroySurface(in);
-                    SDL_DestroySurface(out);
-
-                    dest = resize;
+                if (cancelled) {
+                    std::unique_lock<std::mutex> lock(mutex_);
+                    converting_.clear();
+                    // 今の拡大率で必要ならgetで積み直される
+                    Logger::log("upconvert cancelled:", p.string());
+                    continue;
+                }
+                if (failed || num_resize <= 0) {
+                    // getで拡大縮小したものをそのまま完成品として扱う
+                    std::unique_lock<std::mutex> lock(mutex_);
+                    converting_.clear();
+                    bool updated = generation_.contains(p) && generation_.at(p) != generation;
+                    if (!updated && scale == scale_ && cache_.contains(p) && cache_.at(p)) {
+                        cache_[p] = ImageInfo(cache_.at(p)->buffer(), true);
+                        account(scale, p);
+                    }
+                    continue;
+                }
+                if (info->width() * scale / 100.0 != w) {
+                    int w_resize = std::round(info->width() * scale / 100.0);
+                    int h_resize = std::round(info->height() * scale / 100.0);
+                    prev = resample::resize(prev.data(), w, h, w_resize, h_resize, resample::Filter::Lanczos3, pool_.get());
                     w = w_resize;
                     h = h_resize;
                 }
+                ImageInfo result(std::move(prev), w, h, true);
+                bool current = false;
                 {
                     std::unique_lock<std::mutex> lock(mutex_);
-                    if (scale == scale_) {
-                        cache_[p] = {dest, w, h, true};
+                    converting_.clear();
+                    // 変換の間に元画像が差し替えられていたら古い画素なので捨てる
+                    bool updated = generation_.contains(p) && generation_.at(p) != generation;
+                    if (updated) {
+                        Logger::log("upconvert discarded:", p.string());
+                        continue;
+                    }
+                    // 途中で拡大率が変わっていても、前の拡大率を覚えていればそちらに入れる
+                    auto variant = variants(scale);
+                    if (variant != nullptr) {
+                        (*variant)[p] = result;
+                        account(scale, p);
                     }
+                    current = (scale == scale_);
                 }
+                disk_cache_.store(key, result);
                 Logger::log("upconverted!");
+                // 今の拡大率のものなら描き直させる
+                if (current && event_type_ != 0) {
+                    SDL_Event event = {};
+                    event.type = event_type_;
+                    event.user.data1 = new std::filesystem::path(p);
+                    if (!SDL_PushEvent(&event)) {
+                        delete static_cast<std::filesystem::path *>(event.user.data1);
+                    }
+                }
             }
         });
     }
@@ -110,199 +242,486 @@ ImageCache::ImageCache(const std::filesystem::path &balloon_dir, const std::file
 #endif // USE_ONNX
 
 ImageCache::~ImageCache() {
-    alive_ = false;
     if (th_) {
         {
             std::unique_lock<std::mutex> lock(mutex_);
-            queue_.push("");
+            alive_ = false;
+            // 変換中のものも止める
+            epoch_++;
             cond_.notify_one();
         }
         th_->join();
     }
+    alive_ = false;
 }
 
 void ImageCache::setScale(int scale) {
     std::unique_lock<std::mutex> lock(mutex_);
-    scale_ = scale;
+    if (scale == scale_) {
+        return;
+    }
+    // 前の拡大率の変換は待っているものも途中のものも捨てる
+    queue_.clear();
+    epoch_++;
+    // 元画像は残し、今の拡大率のものは後で戻ってきたときのために取っておく
+    stash_[scale_] = std::move(cache_);
+    recent_scales_.remove(scale_);
+    recent_scales_.push_front(scale_);
     cache_.clear();
+    if (stash_.contains(scale)) {
+        cache_ = std::move(stash_.at(scale));
+        stash_.erase(scale);
+        recent_scales_.remove(scale);
+        // 変換待ちだったものは作り直させる
+        std::erase_if(cache_, [&](const auto &kv) {
+            if (kv.second && !kv.second->isUpconverted()) {
+                forget(scale, kv.first);
+                return true;
+            }
+            return false;
+        });
+    }
+    while (recent_scales_.size() > kScaleHistory) {
+        int old = recent_scales_.back();
+        recent_scales_.pop_back();
+        for (auto &[k, _] : stash_.at(old)) {
+            forget(old, k);
+        }
+        stash_.erase(old);
+    }
+    scale_ = scale;
 }
 
-std::optional<ImageInfo> &ImageCache::getOriginal(const std::filesystem::path &path) {
+std::optional<ImageInfo> ImageCache::getOriginal(const std::filesystem::path &path) {
     Logger::log("scale => ", scale_);
     Logger::log("file: ", path.string());
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (cache_orig_.contains(path)) {
+                touch(0, path);
+                return cache_orig_.at(path);
+            }
+        }
+        // 読み込み中なら終わるのを待つ
+        // 終わってから取り出すまでに追い出されていたら読み直す
+        request(path).wait();
+    }
+}
+
+std::shared_future<void> ImageCache::request(const std::filesystem::path &path) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (pending_.contains(path)) {
+        return pending_.at(path);
+    }
     if (cache_orig_.contains(path)) {
-        return cache_orig_.at(path);
+        std::promise<void> done;
+        done.set_value();
+        return done.get_future().share();
+    }
+    auto future = pool_->submit([this, path]() {
+        // 例外で抜けるとpending_に残り続け、getOriginalが終わらなくなる
+        std::optional<ImageInfo> info;
+        try {
+            info = load(path);
+        }
+        catch (std::exception &e) {
+            Logger::log("failed to load", path.string(), e.what());
+        }
+        std::unique_lock<std::mutex> lock(mutex_);
+        pending_.erase(path);
+        // 待っている間にupdateされていればそちらを使う
+        if (!cache_orig_.contains(path)) {
+            cache_orig_[path] = std::move(info);
+            account(0, path);
+        }
+    }).share();
+    pending_[path] = future;
+    return future;
+}
+
+void ImageCache::preload() {
+    struct Entry {
+        int rank, id;
+        char kind;
+        std::filesystem::path path;
+    };
+    std::vector<Entry> list;
+    std::error_code ec;
+    for (auto &entry : std::filesystem::directory_iterator(balloon_dir_, ec)) {
+        auto name = entry.path().filename().string();
+        // balloon[skc]<id>.png
+        if (name.length() < 12 || !name.starts_with("balloon") || !name.ends_with(".png")) {
+            continue;
+        }
+        char kind = name[7];
+        if (kind != 's' && kind != 'k' && kind != 'c') {
+            continue;
+        }
+        auto digits = name.substr(8, name.length() - 12);
+        if (digits.empty() || digits.find_first_not_of("0123456789") != std::string::npos) {
+            continue;
+        }
+        int id = std::stoi(digits);
+        // s0/k0、その向き違い、入力ボックス、残りの順
+        int rank = 3;
+        if (kind == 'c') {
+            rank = 2;
+        }
+        else if (id < 2) {
+            rank = id;
+        }
+        list.push_back({rank, id, kind, entry.path()});
     }
+    std::sort(list.begin(), list.end(), [](const Entry &a, const Entry &b) {
+        if (a.rank != b.rank) {
+            return a.rank < b.rank;
+        }
+        if (a.id != b.id) {
+            return a.id < b.id;
+        }
+        return a.kind > b.kind;
+    });
+    // poolは先に積んだものから処理する
+    for (auto &e : list) {
+        request(e.path);
+    }
+    Logger::log("preload:", list.size(), "images");
+}
+
+bool ImageCache::ready(const std::filesystem::path &path) {
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (cache_.contains(path) || cache_orig_.contains(path)) {
+            return true;
+        }
+    }
+    auto future = request(path);
+    return future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+std::optional<ImageInfo> ImageCache::decode(const std::filesystem::path &path) const {
     SDL_Surface *in = IMG_Load(path.string().c_str());
     if (in == nullptr) {
-        cache_orig_[path] = std::nullopt;
-        return cache_orig_.at(path);
+        return std::nullopt;
     }
     SDL_Surface *abgr = SDL_ConvertSurface(in, SDL_PIXELFORMAT_ABGR8888);
     SDL_DestroySurface(in);
     int w = abgr->w, h = abgr->h;
+    std::vector<unsigned char> alpha;
+    if (!use_self_alpha_) {
+        auto pna_filename = path.parent_path() / path.stem();
+        pna_filename += ".pna";
+        alpha = loadGray(pna_filename, w, h);
+    }
     std::vector<unsigned char> data;
     data.resize(w * h * 4);
     SDL_LockSurface(abgr);
-    unsigned char *p = static_cast<unsigned char *>(abgr->pixels);
-    for (int i = 0; i < w * h; i++) {
-        // alpha: 0なら全て0にする
-        if (p[4 * i + 3] == 0) {
-            data[4 * i + 0] = 0;
-            data[4 * i + 1] = 0;
-            data[4 * i + 2] = 0;
-            data[4 * i + 3] = 0;
-        }
-        else {
-            data[4 * i + 0] = p[4 * i + 0];
-            data[4 * i + 1] = p[4 * i + 1];
-            data[4 * i + 2] = p[4 * i + 2];
-            data[4 * i + 3] = p[4 * i + 3];
-        }
+    const unsigned char *p = static_cast<const unsigned char *>(abgr->pixels);
+    // pnaが無ければ左上のピクセルの色を透過色にする
+    // alpha=0なら全て0にしてから比べる
+    unsigned char key[3] = {0, 0, 0};
+    bool use_key = !use_self_alpha_ && alpha.empty() && w > 0 && h > 0;
+    if (use_key && p[3] != 0) {
+        key[0] = p[0];
+        key[1] = p[1];
+        key[2] = p[2];
+    }
+    for (int y = 0; y < h; y++) {
+        image_kernel::mergeAlpha(p + y * abgr->pitch, data.data() + 4 * y * w, w, (alpha.empty()) ? (nullptr) : (alpha.data() + y * w), (use_key) ? (key) : (nullptr));
     }
     SDL_UnlockSurface(abgr);
     SDL_DestroySurface(abgr);
+    // そのままだとalphaが0とそうでない部分の境界で
+    // alpha-blendがうまくいかなくなるので
+    // alpha>0なピクセルの値をalpha=0なピクセルに伝播させる
+    image_kernel::bleedAlpha(data.data(), w, h);
+    return ImageInfo(std::move(data), w, h, true);
+}
+
+std::string ImageCache::cacheKey(const std::filesystem::path &path, int scale) const {
+    std::error_code ec;
+    auto size = std::filesystem::file_size(path, ec);
+    if (ec) {
+        return "";
+    }
+    auto mtime = std::filesystem::last_write_time(path, ec);
+    if (ec) {
+        return "";
+    }
+    std::ostringstream oss;
+    oss << kPreprocessVersion << '\n' << path.string() << '\n' << size << '\n' << mtime.time_since_epoch().count() << '\n';
+    // pnaの有無や中身でも結果が変わる
     if (!use_self_alpha_) {
         auto pna_filename = path.parent_path() / path.stem();
         pna_filename += ".pna";
-        SDL_Surface *pna_in = IMG_Load(pna_filename.string().c_str());
-        if (pna_in != nullptr && w == pna_in->w && h == pna_in->h) {
-            SDL_Surface *pna_abgr = SDL_ConvertSurface(pna_in, SDL_PIXELFORMAT_ABGR8888);
-            SDL_DestroySurface(pna_in);
-            SDL_LockSurface(pna_abgr);
-            unsigned char *pna = static_cast<unsigned char *>(pna_abgr->pixels);
-            for (int i = 0; i < w * h; i++) {
-                int alpha = pna[4 * i];
-                data[4 * i + 3] = alpha;
-            }
-            SDL_UnlockSurface(pna_abgr);
-            SDL_DestroySurface(pna_abgr);
+        auto pna_size = std::filesystem::file_size(pna_filename, ec);
+        if (ec) {
+            oss << "-\n";
         }
         else {
-            int r = data[0 + 0];
-            int g = data[0 + 1];
-            int b = data[0 + 2];
-            for (int i = 0; i < w * h; i++) {
-                if (data[4 * i + 0] == r && data[4 * i + 1] == g && data[4 * i + 2] == b) {
-                    data[4 * i + 0] = 0;
-                    data[4 * i + 1] = 0;
-                    data[4 * i + 2] = 0;
-                    data[4 * i + 3] = 0;
-                }
-            }
+            oss << pna_size << '\n' << std::filesystem::last_write_time(pna_filename, ec).time_since_epoch().count() << '\n';
         }
     }
-    // そのままだとalphaが0とそうでない部分の境界で
-    // alpha-blendがうまくいかなくなるので
-    // alpha>0なピクセルの値をalpha=0なピクセルに伝播させる
-    {
-        std::vector<unsigned char> blurred;
-        blurred.resize(data.size());
-        const int blur[3][3] = {
-            {1, 2, 1},
-            {2, 4, 2},
-            {1, 2, 1},
-        };
-        auto in = [](int x, int y, int w, int h) {
-            if (x < 0) {
-                return false;
-            }
-            if (y < 0) {
-                return false;
-            }
-            if (x >= w) {
-                return false;
-            }
-            if (y >= h) {
-                return false;
-            }
-            return true;
-        };
-        for (int y = 0; y < h; y++) {
-            for (int x = 0; x < w; x++) {
-                double n = 0.0;
-                int sum[4] = {};
-                for (int j = -1; j <= 1; j++) {
-                    for (int i = -1; i <= 1; i++) {
-                        if (in(x + i, y + j, w, h)) {
-                            int index = 4 * ((y + j) * w + (x + i));
-                            // alpha>0なピクセルを伝播させるため
-                            // alpha=0なら無視する
-                            if (data[index + 3] == 0) {
-                                continue;
-                            }
-                            auto factor = blur[1 + j][1 + i];
-                            n += factor;
-                            sum[0] += data[index + 0] * factor;
-                            sum[1] += data[index + 1] * factor;
-                            sum[2] += data[index + 2] * factor;
-                            sum[3] += data[index + 3] * factor;
-                        }
-                    }
-                }
-                int index = 4 * (y * w + x);
-                blurred[index + 0] = std::min(255.0, std::ceil(sum[0] / n));
-                blurred[index + 1] = std::min(255.0, std::ceil(sum[1] / n));
-                blurred[index + 2] = std::min(255.0, std::ceil(sum[2] / n));
-                blurred[index + 3] = std::min(255.0, std::ceil(sum[3] / n));
-            }
-        }
-        for (int i = 0; i < w * h; i++) {
-            // alpha以外を伝播
-            if (blurred[4 * i + 3] > 0 && data[4 * i + 3] == 0) {
-                data[4 * i + 0] = blurred[4 * i + 0];
-                data[4 * i + 1] = blurred[4 * i + 1];
-                data[4 * i + 2] = blurred[4 * i + 2];
-            }
-        }
+    oss << use_self_alpha_ << '\n' << scale << '\n';
+    // 保存するのは元画像とモデルで変換したものだけなので拡大縮小の方法は含めない
+    if (scale != 100) {
+        oss << model_hash_;
+    }
+    return oss.str();
+}
+
+std::optional<ImageInfo> ImageCache::load(const std::filesystem::path &path) const {
+    auto key = cacheKey(path, 100);
+    auto cached = disk_cache_.load(key);
+    if (cached) {
+        return cached;
+    }
+    auto info = decode(path);
+    if (info) {
+        disk_cache_.store(key, *info);
     }
-    cache_orig_[path] = {data, w, h, true};
-    return cache_orig_.at(path);
+    return info;
 }
 
-std::optional<ImageInfo> &ImageCache::get(const std::filesystem::path &path) {
+std::optional<ImageInfo> ImageCache::get(const std::filesystem::path &path) {
     {
         std::unique_lock<std::mutex> lock(mutex_);
         if (cache_.contains(path)) {
+            touch(scale_, path);
             return cache_.at(path);
         }
     }
-    auto &info = getOriginal(path);
+    auto info = getOriginal(path);
     if (info == std::nullopt || scale_ == 100) {
+        // 元画像をそのまま共有する
+        std::unique_lock<std::mutex> lock(mutex_);
         cache_[path] = info;
-        return cache_.at(path);
+        account(scale_, path);
+        return info;
+    }
+    // 前にモデルで変換したものがあればそれを使う
+    if (scale_ > 100 && th_) {
+        auto cached = disk_cache_.load(cacheKey(path, scale_));
+        if (cached) {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cache_[path] = cached;
+            account(scale_, path);
+            return cached;
+        }
     }
     int w = std::round(info->width() * scale_ / 100.0);
     int h = std::round(info->height() * scale_ / 100.0);
-    std::vector<unsigned char> resize;
-    resize.resize(w * h * 4);
-
-    SDL_Surface *in = SDL_CreateSurfaceFrom(info->width(), info->height(), SDL_PIXELFORMAT_ABGR8888, info->get().data(), info->width() * 4);
-    SDL_Surface *out = SDL_CreateSurface(w, h, SDL_PIXELFORMAT_ABGR8888);
-    SDL_ClearSurface(out, 0, 0, 0, 0);
-    SDL_BlitSurfaceScaled(in, nullptr, out, nullptr, SDL_SCALEMODE_LINEAR);
-    SDL_LockSurface(out);
-    memcpy(resize.data(), out->pixels, sizeof(unsigned char) * w * h * 4);
-    SDL_UnlockSurface(out);
-    SDL_DestroySurface(in);
-    SDL_DestroySurface(out);
+    auto resize = resample::resize(info->data(), info->width(), info->height(), w, h, filter_, pool_.get());
 
     if (scale_ <= 100 || !th_) {
-        cache_[path] = {resize, w, h, true};
+        // 作り直しても安いのでディスクには書かない
+        ImageInfo result(std::move(resize), w, h, true);
+        std::unique_lock<std::mutex> lock(mutex_);
+        cache_[path] = result;
+        account(scale_, path);
+        return result;
     }
-    else {
-        cache_[path] = {resize, w, h, false};
-        {
-            std::unique_lock<std::mutex> lock(mutex_);
-            queue_.push(path);
-        }
-        cond_.notify_one();
+    ImageInfo result(std::move(resize), w, h, false);
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cache_[path] = result;
+        account(scale_, path);
+        // 積んであればそのまま、順番も変えない
+        queue_.emplace(path, next_seq_++);
     }
+    cond_.notify_one();
+    return result;
+}
 
-    return cache_.at(path);
+void ImageCache::update(const std::filesystem::path &path, std::optional<ImageInfo> info) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    generation_[path]++;
+    if (path == converting_) {
+        epoch_++;
+    }
+    cache_orig_[path] = std::move(info);
+    cache_.erase(path);
+    forget(scale_, path);
+    for (auto &[scale, variant] : stash_) {
+        variant.erase(path);
+        forget(scale, path);
+    }
+    pending_.erase(path);
+    account(0, path);
 }
 
 void ImageCache::clearCache() {
+    std::unique_lock<std::mutex> lock(mutex_);
     cache_.clear();
     cache_orig_.clear();
+    stash_.clear();
+    recent_scales_.clear();
+    pending_.clear();
+    queue_.clear();
+    epoch_++;
+    lru_.clear();
+    usage_.clear();
+    used_ = 0;
+}
+
+ImageCache::ImageMap *ImageCache::variants(int scale) {
+    if (scale == 0) {
+        return &cache_orig_;
+    }
+    if (scale == scale_) {
+        return &cache_;
+    }
+    if (stash_.contains(scale)) {
+        return &stash_.at(scale);
+    }
+    return nullptr;
+}
+
+void ImageCache::touch(int scale, const std::filesystem::path &path) {
+    auto key = Key(scale, path);
+    if (usage_.contains(key)) {
+        auto &u = usage_.at(key);
+        lru_.splice(lru_.begin(), lru_, u.it);
+    }
+}
+
+void ImageCache::account(int scale, const std::filesystem::path &path) {
+    forget(scale, path);
+    auto &info = variants(scale)->at(path);
+    size_t bytes = (info) ? (info->size()) : (0);
+    // 元画像と画素を共有しているなら数えない
+    if (scale != 0 && info && cache_orig_.contains(path)) {
+        auto &orig = cache_orig_.at(path);
+        if (orig && orig->buffer() == info->buffer()) {
+            bytes = 0;
+        }
+    }
+    lru_.emplace_front(scale, path);
+    usage_.emplace(Key(scale, path), Usage{bytes, lru_.begin()});
+    used_ += bytes;
+    evict();
+}
+
+void ImageCache::forget(int scale, const std::filesystem::path &path) {
+    auto key = Key(scale, path);
+    if (!usage_.contains(key)) {
+        return;
+    }
+    auto &u = usage_.at(key);
+    used_ -= u.bytes;
+    lru_.erase(u.it);
+    usage_.erase(key);
+}
+
+void ImageCache::evict() {
+    if (budget_ == 0 || lru_.empty()) {
+        return;
+    }
+    // 最後に使ったものは残す
+    auto it = lru_.end();
+    while (used_ > budget_ && std::prev(it) != lru_.begin()) {
+        --it;
+        Key key = *it;
+        size_t bytes = usage_.at(key).bytes;
+        if (bytes == 0 || pinned_.contains(key.second)) {
+            continue;
+        }
+        variants(key.first)->erase(key.second);
+        if (key.first == 0) {
+            // 等倍のものと共有していた分は残るので数え直す
+            auto same = Key(100, key.second);
+            if (usage_.contains(same) && usage_.at(same).bytes == 0) {
+                auto &info = variants(100)->at(key.second);
+                if (info) {
+                    auto &u = usage_.at(same);
+                    u.bytes = info->size();
+                    used_ += u.bytes;
+                }
+            }
+        }
+        it = lru_.erase(it);
+        usage_.erase(key);
+        used_ -= bytes;
+        evictions_++;
+        evicted_bytes_ += bytes;
+        Logger::log("image cache: evicted", key.second.string(), "at", key.first, bytes, "bytes,", used_, "/", budget_);
+    }
+}
+
+int ImageCache::priority(const std::filesystem::path &path) const {
+    if (pinned_.contains(path)) {
+        return 0;
+    }
+    auto variant = directionVariant(path);
+    if (!variant.empty() && pinned_.contains(variant)) {
+        return 1;
+    }
+    return 2;
+}
+
+std::optional<std::filesystem::path> ImageCache::popQueue() {
+    // 表示しているものは積んだ後で変わるので取り出すときに決める
+    // 数は吹き出し画像の数程度なので線形に探す
+    auto best = queue_.end();
+    int best_priority = 0;
+    for (auto it = queue_.begin(); it != queue_.end(); it++) {
+        int p = priority(it->first);
+        if (best == queue_.end() || p < best_priority || (p == best_priority && it->second < best->second)) {
+            best = it;
+            best_priority = p;
+        }
+    }
+    if (best == queue_.end()) {
+        return std::nullopt;
+    }
+    auto path = best->first;
+    queue_.erase(best);
+    return path;
+}
+
+void ImageCache::setBudget(size_t bytes) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    budget_ = bytes;
+    evict();
+}
+
+void ImageCache::pin(const std::filesystem::path &path) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    pinned_[path]++;
+}
+
+void ImageCache::unpin(const std::filesystem::path &path) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!pinned_.contains(path)) {
+        return;
+    }
+    if (--pinned_.at(path) == 0) {
+        pinned_.erase(path);
+    }
+}
+
+void ImageCache::setFilter(resample::Filter filter) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (filter == filter_) {
+        return;
+    }
+    filter_ = filter;
+    // 拡大縮小したものは全て作り直させる
+    for (auto &[k, _] : cache_) {
+        forget(scale_, k);
+    }
+    cache_.clear();
+    for (auto &[scale, variant] : stash_) {
+        for (auto &[k, _] : variant) {
+            forget(scale, k);
+        }
+    }
+    stash_.clear();
+    recent_scales_.clear();
+}
+
+ImageCache::Stats ImageCache::stats() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return {budget_, used_, evictions_, evicted_bytes_};
 }
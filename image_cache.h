@@ -1,72 +1,157 @@
 #ifndef IMAGE_CACHE_H_
 #define IMAGE_CACHE_H_
 
+#include <atomic>
 #include <condition_variable>
 #include <filesystem>
+#include <future>
+#include <list>
+#include <map>
+#include <memory>
 #include <mutex>
-#if defined(USE_ONNX)
-#include <onnxruntime_cxx_api.h>
-#endif // USE_ONNX
 #include <optional>
-#include <queue>
+#include <string>
 #include <unordered_map>
 #include <vector>
 
-class ImageInfo {
-    private:
-        std::vector<unsigned char> data_;
-        int width_, height_;
-        bool is_upconverted_;
-    public:
-        ImageInfo(const std::vector<unsigned char> &data, int width, int height, bool is_upconverted) : data_(data), width_(width), height_(height), is_upconverted_(is_upconverted) {}
-        ~ImageInfo() {}
-        std::vector<unsigned char> &get() {
-            return data_;
-        }
-        int width() const {
-            return width_;
-        }
-        int height() const {
-            return height_;
-        }
-        bool isUpconverted() const {
-            return is_upconverted_;
-        }
-};
+#include <SDL3/SDL_stdinc.h>
+
+#include "disk_cache.h"
+#include "image_info.h"
+#include "resample.h"
+#include "thread_pool.h"
+#include "upscaler.h"
 
 class ImageCache {
+    public:
+        struct Stats {
+            size_t budget, used;
+            size_t evictions, evicted_bytes;
+        };
+        static constexpr size_t kDefaultBudget = 256 * 1024 * 1024;
+        // 今のもの以外に覚えておく拡大率の数
+        static constexpr size_t kScaleHistory = 2;
     private:
+        using ImageMap = std::unordered_map<std::filesystem::path, std::optional<ImageInfo>>;
+        // 拡大率と画像、0なら元画像
+        using Key = std::pair<int, std::filesystem::path>;
+        struct Usage {
+            size_t bytes;
+            std::list<Key>::iterator it;
+        };
         std::filesystem::path balloon_dir_;
         bool alive_;
         bool use_self_alpha_;
         int scale_;
+        // モデルを使わないときの拡大縮小の方法
+        resample::Filter filter_;
         std::mutex mutex_;
         std::condition_variable cond_;
         std::unique_ptr<std::thread> th_;
-        std::queue<std::filesystem::path> queue_;
-        std::unordered_map<std::filesystem::path, std::optional<ImageInfo>> cache_orig_;
-        std::unordered_map<std::filesystem::path, std::optional<ImageInfo>> cache_;
+        // モデルでの変換待ち、値は積んだ順番
+        // 同じ画像は1つにまとめ、取り出すときに表示中のものを優先する
+        std::unordered_map<std::filesystem::path, size_t> queue_;
+        size_t next_seq_;
+        // 拡大率が変わるか変換中の元画像がupdateされる度に上げ、変換中のものはタイルの合間に止める
+        std::atomic<unsigned int> epoch_;
+        // updateされる度に上げ、変換の間に変わっていたら結果を捨てる
+        std::unordered_map<std::filesystem::path, unsigned int> generation_;
+        // 変換中の画像、updateされたら止める
+        std::filesystem::path converting_;
+        // 変換が終わったことを知らせるイベント、0なら知らせない
+        Uint32 event_type_;
+        ImageMap cache_orig_;
+        // 今の拡大率のもの
+        ImageMap cache_;
+        // 最近使った拡大率のもの、戻ってきたときにそのまま使う
+        std::map<int, ImageMap> stash_;
+        std::list<int> recent_scales_;
+        // 読み込み中のもの、終わったらcache_orig_に結果が入る
+        std::unordered_map<std::filesystem::path, std::shared_future<void>> pending_;
+        // 先頭が最近使ったもの
+        std::list<Key> lru_;
+        std::map<Key, Usage> usage_;
+        // 0なら無制限
+        size_t budget_;
+        size_t used_;
+        size_t evictions_, evicted_bytes_;
+        // 表示中の吹き出し画像、追い出さない
+        std::unordered_map<std::filesystem::path, int> pinned_;
+        DiskCache disk_cache_;
+        // モデルの中身のハッシュ、モデルを使わないなら空
+        std::string model_hash_;
 #if defined(USE_ONNX)
-        Ort::Env env_;
-        Ort::Session session_;
+        std::unique_ptr<Upscaler> upscaler_;
 #endif // USE_ONNX
+        // 他のメンバを参照するので最後に置く
+        std::unique_ptr<ThreadPool> pool_;
 
-        std::optional<ImageInfo> &getOriginal(const std::filesystem::path &path);
+        std::optional<ImageInfo> getOriginal(const std::filesystem::path &path);
+        // ディスクキャッシュのキー、元のファイルが無ければ空
+        // scaleが100なら元画像、それ以外はモデルで変換したもの
+        std::string cacheKey(const std::filesystem::path &path, int scale) const;
+        // 以下はmutex_を取った状態で呼ぶ
+        // scaleの画像を入れているもの、無ければnullptr
+        ImageMap *variants(int scale);
+        void touch(int scale, const std::filesystem::path &path);
+        void account(int scale, const std::filesystem::path &path);
+        void forget(int scale, const std::filesystem::path &path);
+        void evict();
+        // 0が表示中、1がその向き違い、2がその他
+        int priority(const std::filesystem::path &path) const;
+        std::optional<std::filesystem::path> popQueue();
 
     public:
 #if defined(USE_ONNX)
         ImageCache(const std::filesystem::path &balloon_dir, const std::filesystem::path &exe_dir, bool use_self_alpha);
 #else
         ImageCache(const std::filesystem::path &balloon_dir, const std::filesystem::path &exe_dir, bool use_self_alpha)
-        : balloon_dir_(balloon_dir), alive_(true), use_self_alpha_(use_self_alpha), scale_(100) {}
+        : balloon_dir_(balloon_dir), alive_(true), use_self_alpha_(use_self_alpha), scale_(100), filter_(resample::Filter::Lanczos3), next_seq_(0), epoch_(0), event_type_(0), budget_(kDefaultBudget), used_(0), evictions_(0), evicted_bytes_(0), pool_(std::make_unique<ThreadPool>()) {}
 #endif // USE_ONNX
         ~ImageCache();
         void setScale(int scale);
-        std::optional<ImageInfo> &getRelative(const std::filesystem::path &relative_path) {
+        // 画素は共有されるので返り値は複製しても安い
+        std::optional<ImageInfo> getRelative(const std::filesystem::path &relative_path) {
             return get(balloon_dir_ / relative_path);
         }
-        std::optional<ImageInfo> &get(const std::filesystem::path &path);
+        std::optional<ImageInfo> get(const std::filesystem::path &path);
+        // 別スレッドでの読み込みを予約する
+        std::shared_future<void> request(const std::filesystem::path &path);
+        std::shared_future<void> requestRelative(const std::filesystem::path &relative_path) {
+            return request(balloon_dir_ / relative_path);
+        }
+        // getがすぐに返せるか、読み込んでいなければ予約だけする
+        bool ready(const std::filesystem::path &path);
+        bool readyRelative(const std::filesystem::path &relative_path) {
+            return ready(balloon_dir_ / relative_path);
+        }
+        // 吹き出し画像を使われそうな順に全て読み込んでおく
+        void preload();
+        // キャッシュには触らないので別スレッドから呼んでも良い
+        std::optional<ImageInfo> decode(const std::filesystem::path &path) const;
+        // ディスクキャッシュにあればそれを、無ければdecodeして保存する
+        // decodeと同じく別スレッドから呼んでも良い
+        std::optional<ImageInfo> load(const std::filesystem::path &path) const;
+        // pathの画像をinfoに差し替え、拡大縮小したものは作り直させる
+        void update(const std::filesystem::path &path, std::optional<ImageInfo> info);
         void clearCache();
+        // 元画像と拡大縮小したものの合計をbytes以下に抑える
+        void setBudget(size_t bytes);
+        void pin(const std::filesystem::path &path);
+        void pinRelative(const std::filesystem::path &relative_path) {
+            pin(balloon_dir_ / relative_path);
+        }
+        void unpin(const std::filesystem::path &path);
+        void unpinRelative(const std::filesystem::path &relative_path) {
+            unpin(balloon_dir_ / relative_path);
+        }
+        // 拡大縮小したものは作り直しになる
+        void setFilter(resample::Filter filter);
+        Stats stats();
+        // data1に変換が終わった画像のパスをnewしたものが入る
+        Uint32 eventType() const {
+            return event_type_;
+        }
 };
 
 #endif // IMAGE_CACHE_H_
@@ -0,0 +1,65 @@
+#ifndef IMAGE_INFO_H_
+#define IMAGE_INFO_H_
+
+#include <memory>
+#include <vector>
+
+// 画素の実体、作った後は変更しない
+// 複製はせずshared_ptrで共有する
+class ImageBuffer {
+    private:
+        std::vector<unsigned char> storage_;
+        // storage_を使わないときの持ち主、ファイルのmappingなど
+        std::shared_ptr<const void> owner_;
+        const unsigned char *data_;
+        int width_, height_;
+    public:
+        ImageBuffer(std::vector<unsigned char> &&data, int width, int height) : storage_(std::move(data)), data_(storage_.data()), width_(width), height_(height) {}
+        ImageBuffer(std::shared_ptr<const void> owner, const unsigned char *data, int width, int height) : owner_(std::move(owner)), data_(data), width_(width), height_(height) {}
+        ImageBuffer(const ImageBuffer &) = delete;
+        ImageBuffer &operator=(const ImageBuffer &) = delete;
+        ~ImageBuffer() {}
+        const unsigned char *data() const {
+            return data_;
+        }
+        size_t size() const {
+            return 4 * static_cast<size_t>(width_) * height_;
+        }
+        int width() const {
+            return width_;
+        }
+        int height() const {
+            return height_;
+        }
+};
+
+// ImageBufferへの参照、コピーしても画素は共有される
+class ImageInfo {
+    private:
+        std::shared_ptr<const ImageBuffer> buffer_;
+        bool is_upconverted_;
+    public:
+        ImageInfo(std::vector<unsigned char> &&data, int width, int height, bool is_upconverted) : buffer_(std::make_shared<const ImageBuffer>(std::move(data), width, height)), is_upconverted_(is_upconverted) {}
+        ImageInfo(std::shared_ptr<const ImageBuffer> buffer, bool is_upconverted) : buffer_(std::move(buffer)), is_upconverted_(is_upconverted) {}
+        ~ImageInfo() {}
+        const std::shared_ptr<const ImageBuffer> &buffer() const {
+            return buffer_;
+        }
+        const unsigned char *data() const {
+            return buffer_->data();
+        }
+        size_t size() const {
+            return buffer_->size();
+        }
+        int width() const {
+            return buffer_->width();
+        }
+        int height() const {
+            return buffer_->height();
+        }
+        bool isUpconverted() const {
+            return is_upconverted_;
+        }
+};
+
+#endif // IMAGE_INFO_H_
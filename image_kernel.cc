@@ -0,0 +1,281 @@
+#include "image_kernel.h"
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define IMAGE_KERNEL_USE_X86 1
+#endif // x86
+
+namespace {
+    void mergeAlphaScalar(const unsigned char *src, unsigned char *dst, int w, const unsigned char *alpha, const unsigned char *key, int begin) {
+        for (int x = begin; x < w; x++) {
+            const unsigned char *s = src + 4 * x;
+            unsigned char *d = dst + 4 * x;
+            if (s[3] == 0) {
+                d[0] = d[1] = d[2] = d[3] = 0;
+            }
+            else {
+                d[0] = s[0];
+                d[1] = s[1];
+                d[2] = s[2];
+                d[3] = s[3];
+            }
+            if (alpha != nullptr) {
+                d[3] = alpha[x];
+            }
+            else if (key != nullptr && d[0] == key[0] && d[1] == key[1] && d[2] == key[2]) {
+                d[0] = d[1] = d[2] = d[3] = 0;
+            }
+        }
+    }
+
+    void mergeAlphaScalar(const unsigned char *src, unsigned char *dst, int w, const unsigned char *alpha, const unsigned char *key) {
+        mergeAlphaScalar(src, dst, w, alpha, key, 0);
+    }
+
+    // 重みは{1, 2, 1}x{1, 2, 1}なので横と縦に分けて足す
+    // 横方向の和はピクセル毎にR,G,B,重みの合計の4つ
+    void sumRow(const unsigned char *src, int w, int32_t *dst) {
+        auto add = [](int32_t *d, const unsigned char *p, int factor) {
+            if (p[3] == 0) {
+                return;
+            }
+            d[0] += p[0] * factor;
+            d[1] += p[1] * factor;
+            d[2] += p[2] * factor;
+            d[3] += factor;
+        };
+        memset(dst, 0, sizeof(int32_t) * 4 * w);
+        if (w == 1) {
+            add(dst, src, 2);
+            return;
+        }
+        add(dst, src, 2);
+        add(dst, src + 4, 1);
+        for (int x = 1; x < w - 1; x++) {
+            int32_t *d = dst + 4 * x;
+            const unsigned char *p = src + 4 * x;
+            add(d, p - 4, 1);
+            add(d, p, 2);
+            add(d, p + 4, 1);
+        }
+        add(dst + 4 * (w - 1), src + 4 * (w - 2), 1);
+        add(dst + 4 * (w - 1), src + 4 * (w - 1), 2);
+    }
+
+    // alpha=0のピクセルの色を決める
+    // 重みの合計が0なら白、それ以外は切り上げた平均
+    void bleedRowScalar(unsigned char *row, int w, const int32_t *prev, const int32_t *cur, const int32_t *next, int begin) {
+        for (int x = begin; x < w; x++) {
+            unsigned char *p = row + 4 * x;
+            if (p[3] != 0) {
+                continue;
+            }
+            int32_t s[4];
+            for (int c = 0; c < 4; c++) {
+                s[c] = prev[4 * x + c] + 2 * cur[4 * x + c] + next[4 * x + c];
+            }
+            int32_t n = s[3];
+            for (int c = 0; c < 3; c++) {
+                p[c] = (n == 0) ? (255) : ((s[c] + n - 1) / n);
+            }
+        }
+    }
+
+    void bleedRowScalar(unsigned char *row, int w, const int32_t *prev, const int32_t *cur, const int32_t *next) {
+        bleedRowScalar(row, w, prev, cur, next, 0);
+    }
+
+#if defined(IMAGE_KERNEL_USE_X86)
+    __attribute__((target("sse2")))
+    void bleedRowSSE2(unsigned char *row, int w, const int32_t *prev, const int32_t *cur, const int32_t *next) {
+        const __m128i white = _mm_set1_epi32(255);
+        const __m128i zero = _mm_setzero_si128();
+        for (int x = 0; x < w; x++) {
+            unsigned char *p = row + 4 * x;
+            if (p[3] != 0) {
+                continue;
+            }
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(prev + 4 * x));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(cur + 4 * x));
+            __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(next + 4 * x));
+            __m128i s = _mm_add_epi32(_mm_add_epi32(a, c), _mm_slli_epi32(b, 1));
+            __m128i n = _mm_shuffle_epi32(s, _MM_SHUFFLE(3, 3, 3, 3));
+            __m128 q = _mm_div_ps(_mm_cvtepi32_ps(s), _mm_cvtepi32_ps(n));
+            // 切り上げ、SSE2にはceilが無いので切り捨ててから補正する
+            __m128i t = _mm_cvttps_epi32(q);
+            t = _mm_sub_epi32(t, _mm_castps_si128(_mm_cmplt_ps(_mm_cvtepi32_ps(t), q)));
+            __m128i empty = _mm_cmpeq_epi32(n, zero);
+            t = _mm_or_si128(_mm_and_si128(empty, white), _mm_andnot_si128(empty, t));
+            t = _mm_packus_epi16(_mm_packs_epi32(t, t), zero);
+            uint32_t v = _mm_cvtsi128_si32(t);
+            // alphaは0のまま
+            v &= 0x00ffffffu;
+            memcpy(p, &v, sizeof(v));
+        }
+    }
+
+    __attribute__((target("avx2")))
+    void bleedRowAVX2(unsigned char *row, int w, const int32_t *prev, const int32_t *cur, const int32_t *next) {
+        const __m256i white = _mm256_set1_epi32(255);
+        const __m256i zero = _mm256_setzero_si256();
+        int x = 0;
+        for (; x + 2 <= w; x += 2) {
+            unsigned char *p = row + 4 * x;
+            if (p[3] != 0 && p[7] != 0) {
+                continue;
+            }
+            __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(prev + 4 * x));
+            __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(cur + 4 * x));
+            __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(next + 4 * x));
+            __m256i s = _mm256_add_epi32(_mm256_add_epi32(a, c), _mm256_slli_epi32(b, 1));
+            __m256i n = _mm256_shuffle_epi32(s, _MM_SHUFFLE(3, 3, 3, 3));
+            __m256 q = _mm256_div_ps(_mm256_cvtepi32_ps(s), _mm256_cvtepi32_ps(n));
+            __m256i t = _mm256_cvttps_epi32(_mm256_ceil_ps(q));
+            __m256i empty = _mm256_cmpeq_epi32(n, zero);
+            t = _mm256_blendv_epi8(t, white, empty);
+            t = _mm256_packus_epi16(_mm256_packs_epi32(t, t), zero);
+            uint32_t v[2] = {
+                static_cast<uint32_t>(_mm256_extract_epi32(t, 0)) & 0x00ffffffu,
+                static_cast<uint32_t>(_mm256_extract_epi32(t, 4)) & 0x00ffffffu,
+            };
+            if (p[3] == 0) {
+                memcpy(p, &v[0], sizeof(uint32_t));
+            }
+            if (p[7] == 0) {
+                memcpy(p + 4, &v[1], sizeof(uint32_t));
+            }
+        }
+        bleedRowScalar(row, w, prev, cur, next, x);
+    }
+
+    // 以下ピクセルは32bitで読む、リトルエンディアンなのでalphaが最上位
+    __attribute__((target("sse2")))
+    void mergeAlphaSSE2(const unsigned char *src, unsigned char *dst, int w, const unsigned char *alpha, const unsigned char *key) {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i alpha_mask = _mm_set1_epi32(0xff000000u);
+        const __m128i color_mask = _mm_set1_epi32(0x00ffffff);
+        __m128i k = zero;
+        if (key != nullptr) {
+            k = _mm_set1_epi32(key[0] | (key[1] << 8) | (key[2] << 16));
+        }
+        int x = 0;
+        for (; x + 4 <= w; x += 4) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 4 * x));
+            v = _mm_andnot_si128(_mm_cmpeq_epi32(_mm_and_si128(v, alpha_mask), zero), v);
+            if (alpha != nullptr) {
+                uint32_t a;
+                memcpy(&a, alpha + x, sizeof(a));
+                __m128i t = _mm_unpacklo_epi8(zero, _mm_cvtsi32_si128(a));
+                t = _mm_unpacklo_epi16(zero, t);
+                v = _mm_or_si128(_mm_and_si128(v, color_mask), t);
+            }
+            else if (key != nullptr) {
+                v = _mm_andnot_si128(_mm_cmpeq_epi32(_mm_and_si128(v, color_mask), k), v);
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 4 * x), v);
+        }
+        mergeAlphaScalar(src, dst, w, alpha, key, x);
+    }
+
+    __attribute__((target("avx2")))
+    void mergeAlphaAVX2(const unsigned char *src, unsigned char *dst, int w, const unsigned char *alpha, const unsigned char *key) {
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i alpha_mask = _mm256_set1_epi32(0xff000000u);
+        const __m256i color_mask = _mm256_set1_epi32(0x00ffffff);
+        __m256i k = zero;
+        if (key != nullptr) {
+            k = _mm256_set1_epi32(key[0] | (key[1] << 8) | (key[2] << 16));
+        }
+        int x = 0;
+        for (; x + 8 <= w; x += 8) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + 4 * x));
+            v = _mm256_andnot_si256(_mm256_cmpeq_epi32(_mm256_and_si256(v, alpha_mask), zero), v);
+            if (alpha != nullptr) {
+                __m256i t = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(alpha + x)));
+                v = _mm256_or_si256(_mm256_and_si256(v, color_mask), _mm256_slli_epi32(t, 24));
+            }
+            else if (key != nullptr) {
+                v = _mm256_andnot_si256(_mm256_cmpeq_epi32(_mm256_and_si256(v, color_mask), k), v);
+            }
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + 4 * x), v);
+        }
+        mergeAlphaScalar(src, dst, w, alpha, key, x);
+    }
+
+    using MergeFunc = void (*)(const unsigned char *, unsigned char *, int, const unsigned char *, const unsigned char *);
+
+    MergeFunc selectMergeAlpha() {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            return mergeAlphaAVX2;
+        }
+        if (__builtin_cpu_supports("sse2")) {
+            return mergeAlphaSSE2;
+        }
+        return mergeAlphaScalar;
+    }
+
+    const MergeFunc merge_alpha = selectMergeAlpha();
+
+    using BleedFunc = void (*)(unsigned char *, int, const int32_t *, const int32_t *, const int32_t *);
+
+    BleedFunc selectBleedRow() {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            return bleedRowAVX2;
+        }
+        if (__builtin_cpu_supports("sse2")) {
+            return bleedRowSSE2;
+        }
+        return bleedRowScalar;
+    }
+
+    const BleedFunc bleed_row = selectBleedRow();
+#else
+    const auto merge_alpha = static_cast<void (*)(const unsigned char *, unsigned char *, int, const unsigned char *, const unsigned char *)>(mergeAlphaScalar);
+    const auto bleed_row = static_cast<void (*)(unsigned char *, int, const int32_t *, const int32_t *, const int32_t *)>(bleedRowScalar);
+#endif // IMAGE_KERNEL_USE_X86
+}
+
+namespace image_kernel {
+    void mergeAlpha(const unsigned char *src, unsigned char *dst, int w, const unsigned char *alpha, const unsigned char *key) {
+        merge_alpha(src, dst, w, alpha, key);
+    }
+
+    void bleedAlpha(unsigned char *data, int w, int h) {
+        if (w <= 0 || h <= 0) {
+            return;
+        }
+        // 書き換えるのはalpha=0のピクセルだけで、それは他のピクセルの計算に使われないので
+        // 横方向の和を3行分だけ持っておけばその場で書き換えられる
+        size_t stride = 4 * static_cast<size_t>(w);
+        std::vector<int32_t> buffer(4 * stride, 0);
+        int32_t *zero = buffer.data();
+        int32_t *rows[3] = {
+            buffer.data() + stride,
+            buffer.data() + 2 * stride,
+            buffer.data() + 3 * stride,
+        };
+        sumRow(data, w, rows[1]);
+        if (h > 1) {
+            sumRow(data + stride, w, rows[2]);
+        }
+        for (int y = 0; y < h; y++) {
+            const int32_t *prev = (y > 0) ? (rows[0]) : (zero);
+            const int32_t *next = (y + 1 < h) ? (rows[2]) : (zero);
+            bleed_row(data + y * stride, w, prev, rows[1], next);
+            // 1行ずらす
+            int32_t *tmp = rows[0];
+            rows[0] = rows[1];
+            rows[1] = rows[2];
+            rows[2] = tmp;
+            if (y + 2 < h) {
+                sumRow(data + (y + 2) * stride, w, rows[2]);
+            }
+        }
+    }
+}
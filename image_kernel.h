@@ -0,0 +1,16 @@
+#ifndef IMAGE_KERNEL_H_
+#define IMAGE_KERNEL_H_
+
+// ABGR8888(byte順でR,G,B,A)の画像に対する前処理
+namespace image_kernel {
+    // 1行分のsrcをdstに写す、alpha=0のピクセルは全て0にする
+    // alphaがあればそれをalphaにし、無ければkeyと同じ色のピクセルを透明にする
+    // keyも無ければalphaはそのまま
+    void mergeAlpha(const unsigned char *src, unsigned char *dst, int w, const unsigned char *alpha, const unsigned char *key);
+
+    // alpha=0のピクセルの色を周囲のalpha>0なピクセルの3x3の重み付き平均にする
+    // 周囲にも無ければ白にする、alphaは変えない
+    void bleedAlpha(unsigned char *data, int w, int h);
+}
+
+#endif // IMAGE_KERNEL_H_
@@ -0,0 +1,306 @@
+#include "line_break.h"
+
+#include <algorithm>
+#include <array>
+
+namespace {
+    using line_break::Class;
+
+    struct Range {
+        char32_t begin, end;
+        Class cls;
+    };
+
+    constexpr std::array<Class, 0x80> kASCII = []() {
+        std::array<Class, 0x80> table = {};
+        for (auto &c : table) {
+            c = Class::AL;
+        }
+        for (char32_t c = 0; c < 0x20; c++) {
+            table[c] = Class::CM;
+        }
+        table[0x7f] = Class::CM;
+        table['\t'] = Class::BA;
+        table[' '] = Class::SP;
+        table['!'] = Class::EX;
+        table['?'] = Class::EX;
+        table['"'] = Class::QU;
+        table['\''] = Class::QU;
+        table['('] = Class::OP;
+        table['['] = Class::OP;
+        table['{'] = Class::OP;
+        table[')'] = Class::CP;
+        table[']'] = Class::CP;
+        table['}'] = Class::CL;
+        table[','] = Class::IS;
+        table['.'] = Class::IS;
+        table[':'] = Class::IS;
+        table[';'] = Class::IS;
+        table['/'] = Class::IS;
+        table['-'] = Class::HY;
+        for (char32_t c = '0'; c <= '9'; c++) {
+            table[c] = Class::NU;
+        }
+        return table;
+    }();
+
+    // 昇順かつ重複なし、ここに無い文字はAL
+    constexpr Range kRange[] = {
+        {0x00a0, 0x00a0, Class::GL},
+        {0x00ab, 0x00ab, Class::QU},
+        {0x00bb, 0x00bb, Class::QU},
+        {0x0300, 0x036f, Class::CM},
+        {0x2010, 0x2010, Class::BA},
+        {0x2011, 0x2011, Class::GL},
+        {0x2013, 0x2013, Class::BA},
+        {0x2014, 0x2015, Class::ID},
+        {0x2018, 0x2019, Class::QU},
+        {0x201c, 0x201d, Class::QU},
+        {0x2024, 0x2026, Class::IN},
+        {0x203c, 0x203c, Class::NS},
+        {0x2047, 0x2049, Class::NS},
+        {0x2e80, 0x2fff, Class::ID},
+        {0x3000, 0x3000, Class::BA},
+        {0x3001, 0x3002, Class::CL},
+        {0x3003, 0x3004, Class::ID},
+        {0x3005, 0x3005, Class::NS},
+        {0x3006, 0x3007, Class::ID},
+        {0x3008, 0x3008, Class::OP},
+        {0x3009, 0x3009, Class::CL},
+        {0x300a, 0x300a, Class::OP},
+        {0x300b, 0x300b, Class::CL},
+        {0x300c, 0x300c, Class::OP},
+        {0x300d, 0x300d, Class::CL},
+        {0x300e, 0x300e, Class::OP},
+        {0x300f, 0x300f, Class::CL},
+        {0x3010, 0x3010, Class::OP},
+        {0x3011, 0x3011, Class::CL},
+        {0x3012, 0x3013, Class::ID},
+        {0x3014, 0x3014, Class::OP},
+        {0x3015, 0x3015, Class::CL},
+        {0x3016, 0x3016, Class::OP},
+        {0x3017, 0x3017, Class::CL},
+        {0x3018, 0x3018, Class::OP},
+        {0x3019, 0x3019, Class::CL},
+        {0x301a, 0x301a, Class::OP},
+        {0x301b, 0x301b, Class::CL},
+        {0x301c, 0x301c, Class::NS},
+        {0x301d, 0x301d, Class::OP},
+        {0x301e, 0x301f, Class::CL},
+        {0x3020, 0x3040, Class::ID},
+        // ぁぃぅぇぉ
+        {0x3041, 0x3041, Class::NS},
+        {0x3042, 0x3042, Class::ID},
+        {0x3043, 0x3043, Class::NS},
+        {0x3044, 0x3044, Class::ID},
+        {0x3045, 0x3045, Class::NS},
+        {0x3046, 0x3046, Class::ID},
+        {0x3047, 0x3047, Class::NS},
+        {0x3048, 0x3048, Class::ID},
+        {0x3049, 0x3049, Class::NS},
+        {0x304a, 0x3062, Class::ID},
+        // っ
+        {0x3063, 0x3063, Class::NS},
+        {0x3064, 0x3082, Class::ID},
+        // ゃゅょ
+        {0x3083, 0x3083, Class::NS},
+        {0x3084, 0x3084, Class::ID},
+        {0x3085, 0x3085, Class::NS},
+        {0x3086, 0x3086, Class::ID},
+        {0x3087, 0x3087, Class::NS},
+        {0x3088, 0x308d, Class::ID},
+        // ゎ
+        {0x308e, 0x308e, Class::NS},
+        {0x308f, 0x3094, Class::ID},
+        // ゕゖ
+        {0x3095, 0x3096, Class::NS},
+        {0x3097, 0x309a, Class::ID},
+        // ゛゜ゝゞ゠
+        {0x309b, 0x30a0, Class::NS},
+        // ァィゥェォ
+        {0x30a1, 0x30a1, Class::NS},
+        {0x30a2, 0x30a2, Class::ID},
+        {0x30a3, 0x30a3, Class::NS},
+        {0x30a4, 0x30a4, Class::ID},
+        {0x30a5, 0x30a5, Class::NS},
+        {0x30a6, 0x30a6, Class::ID},
+        {0x30a7, 0x30a7, Class::NS},
+        {0x30a8, 0x30a8, Class::ID},
+        {0x30a9, 0x30a9, Class::NS},
+        {0x30aa, 0x30c2, Class::ID},
+        // ッ
+        {0x30c3, 0x30c3, Class::NS},
+        {0x30c4, 0x30e2, Class::ID},
+        // ャュョ
+        {0x30e3, 0x30e3, Class::NS},
+        {0x30e4, 0x30e4, Class::ID},
+        {0x30e5, 0x30e5, Class::NS},
+        {0x30e6, 0x30e6, Class::ID},
+        {0x30e7, 0x30e7, Class::NS},
+        {0x30e8, 0x30ed, Class::ID},
+        // ヮ
+        {0x30ee, 0x30ee, Class::NS},
+        {0x30ef, 0x30f4, Class::ID},
+        // ヵヶ
+        {0x30f5, 0x30f6, Class::NS},
+        {0x30f7, 0x30fa, Class::ID},
+        // ・ーヽヾ
+        {0x30fb, 0x30fe, Class::NS},
+        {0x30ff, 0x31ef, Class::ID},
+        {0x31f0, 0x31ff, Class::NS},
+        {0x3200, 0x4dbf, Class::ID},
+        {0x4e00, 0x9fff, Class::ID},
+        {0xf900, 0xfaff, Class::ID},
+        {0xff01, 0xff01, Class::EX},
+        {0xff02, 0xff07, Class::ID},
+        {0xff08, 0xff08, Class::OP},
+        {0xff09, 0xff09, Class::CL},
+        {0xff0a, 0xff0b, Class::ID},
+        {0xff0c, 0xff0c, Class::CL},
+        {0xff0d, 0xff0d, Class::ID},
+        {0xff0e, 0xff0e, Class::CL},
+        {0xff0f, 0xff19, Class::ID},
+        {0xff1a, 0xff1b, Class::NS},
+        {0xff1c, 0xff1e, Class::ID},
+        {0xff1f, 0xff1f, Class::EX},
+        {0xff20, 0xff3a, Class::ID},
+        {0xff3b, 0xff3b, Class::OP},
+        {0xff3c, 0xff3c, Class::ID},
+        {0xff3d, 0xff3d, Class::CL},
+        {0xff3e, 0xff5a, Class::ID},
+        {0xff5b, 0xff5b, Class::OP},
+        {0xff5c, 0xff5c, Class::ID},
+        {0xff5d, 0xff5d, Class::CL},
+        {0xff5e, 0xff5e, Class::ID},
+        {0xff5f, 0xff5f, Class::OP},
+        {0xff60, 0xff61, Class::CL},
+        {0xff62, 0xff62, Class::OP},
+        {0xff63, 0xff64, Class::CL},
+        {0xff65, 0xff65, Class::NS},
+        {0xff66, 0xff66, Class::ID},
+        // ｧ-ｰ
+        {0xff67, 0xff70, Class::NS},
+        {0xff71, 0xff9d, Class::ID},
+        {0xff9e, 0xff9f, Class::NS},
+        {0x1f000, 0x1faff, Class::ID},
+        {0x20000, 0x3fffd, Class::ID},
+    };
+
+    constexpr bool isSorted() {
+        for (size_t i = 0; i < std::size(kRange); i++) {
+            if (kRange[i].begin > kRange[i].end) {
+                return false;
+            }
+            if (i > 0 && kRange[i - 1].end >= kRange[i].begin) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static_assert(isSorted());
+}
+
+namespace line_break {
+    Class classOf(char32_t c) {
+        if (c < 0x80) {
+            return kASCII[c];
+        }
+        auto it = std::upper_bound(std::begin(kRange), std::end(kRange), c, [](char32_t c, const Range &r) {
+            return c < r.begin;
+        });
+        if (it == std::begin(kRange)) {
+            return Class::AL;
+        }
+        --it;
+        if (c <= it->end) {
+            return it->cls;
+        }
+        return Class::AL;
+    }
+
+    bool isProhibitedAtLineStart(Class c) {
+        switch (c) {
+            case Class::CL:
+            case Class::CP:
+            case Class::EX:
+            case Class::IS:
+            case Class::NS:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    bool canBreak(Class before, bool after_space, Class after) {
+        // LB7, LB9, LB11-13, LB21: 直前で改行しない
+        switch (after) {
+            case Class::SP:
+            case Class::CM:
+            case Class::GL:
+            case Class::BA:
+            case Class::HY:
+                return false;
+            default:
+                break;
+        }
+        if (isProhibitedAtLineStart(after)) {
+            return false;
+        }
+        // LB14: OP SP* ×
+        if (before == Class::OP) {
+            return false;
+        }
+        // LB18: SP ÷
+        if (after_space) {
+            return true;
+        }
+        // LB12, LB19: GL ×, QU × / × QU
+        if (before == Class::GL || before == Class::QU || after == Class::QU) {
+            return false;
+        }
+        bool before_word = before == Class::AL || before == Class::NU;
+        bool after_word = after == Class::AL || after == Class::NU;
+        // LB23, LB28: 英数字の途中
+        if (before_word && after_word) {
+            return false;
+        }
+        // LB25, LB29: 1.5 / a.b / -1
+        if ((before == Class::IS || before == Class::HY) && after == Class::NU) {
+            return false;
+        }
+        if (before == Class::IS && after == Class::AL) {
+            return false;
+        }
+        // LB30: AL/NU × OP, CP × AL/NU
+        if (before_word && after == Class::OP) {
+            return false;
+        }
+        if (before == Class::CP && after_word) {
+            return false;
+        }
+        // LB22
+        if (before == Class::IN && after == Class::IN) {
+            return false;
+        }
+        return true;
+    }
+}
+
+bool LineBreaker::feed(char32_t c, size_t offset, int width) {
+    auto cls = line_break::classOf(c);
+    bool ret = valid_ && offset > 0 && line_break::canBreak(prev_, after_space_, cls);
+    if (ret) {
+        offset_ = offset;
+        width_ = width;
+    }
+    if (cls == line_break::Class::SP) {
+        after_space_ = true;
+    }
+    else if (cls != line_break::Class::CM || !valid_) {
+        prev_ = cls;
+        after_space_ = false;
+    }
+    valid_ = true;
+    return ret;
+}
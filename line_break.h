@@ -0,0 +1,59 @@
+#ifndef LINE_BREAK_H_
+#define LINE_BREAK_H_
+
+#include <cstddef>
+#include <cstdint>
+
+// UAX #14のクラスのうちバルーンの折り返しに必要なものだけ
+namespace line_break {
+    enum class Class : uint8_t {
+        AL, BA, CL, CM, CP, EX, GL, HY, ID, IN, IS, NS, NU, OP, QU, SP,
+    };
+
+    Class classOf(char32_t c);
+
+    // 行頭に置けない(行頭禁則)
+    bool isProhibitedAtLineStart(Class c);
+
+    // beforeの後ろにafterが来るとき、その間で改行できるか
+    // after_spaceはbeforeとafterの間にSPがあるか
+    bool canBreak(Class before, bool after_space, Class after);
+}
+
+// 現在の行(最後のchunk)の改行可能な位置を1文字ずつ記録する
+class LineBreaker {
+    private:
+        bool valid_;
+        line_break::Class prev_;
+        bool after_space_;
+        size_t offset_;
+        int width_;
+    public:
+        LineBreaker() {
+            reset();
+        }
+        ~LineBreaker() {}
+        void reset() {
+            valid_ = false;
+            prev_ = line_break::Class::AL;
+            after_space_ = false;
+            offset_ = 0;
+            width_ = 0;
+        }
+        // 行頭からoffset byte目、幅widthの位置にcを置く
+        // cの直前で改行できるならtrue
+        bool feed(char32_t c, size_t offset, int width);
+        bool valid() const {
+            return valid_;
+        }
+        // 最後に見つかった改行可能な位置、無ければ0
+        size_t offset() const {
+            return offset_;
+        }
+        // offset()までの幅
+        int width() const {
+            return width_;
+        }
+};
+
+#endif // LINE_BREAK_H_
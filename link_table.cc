@@ -0,0 +1,112 @@
+#include "link_table.h"
+
+#include <algorithm>
+
+void LinkTable::build(const post::Post &post) {
+    clear();
+    std::vector<Entry> entries;
+    bool in_link = false;
+    for (size_t i = 0; i < post.size(); i++) {
+        auto &head = post.head[i];
+        if (head.link_begin) {
+            auto &begin = head.link_begin.value();
+            links_.push_back({
+                .id = begin.id,
+                .hit_region_list = {},
+                .content = {
+                    .is_anchor = begin.is_anchor,
+                    .text = "",
+                    .event = begin.event,
+                    .args = begin.args,
+                },
+            });
+            in_link = true;
+        }
+        if (in_link) {
+            auto &link = links_.back();
+            auto &p = post.position[i];
+            link.hit_region_list.push_back(p);
+            if (post.content[i].type == post::ContentType::Text) {
+                link.content.text += post.data(i);
+            }
+            if (p.w > 0 && p.h > 0) {
+                entries.push_back({p, static_cast<int>(links_.size()) - 1, 0});
+            }
+        }
+        if (head.link_end) {
+            in_link = false;
+        }
+    }
+    std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) {
+        if (a.rect.y != b.rect.y) {
+            return a.rect.y < b.rect.y;
+        }
+        if (a.rect.h != b.rect.h) {
+            return a.rect.h < b.rect.h;
+        }
+        if (a.rect.x != b.rect.x) {
+            return a.rect.x < b.rect.x;
+        }
+        return a.index < b.index;
+    });
+    for (auto &e : entries) {
+        int bottom = e.rect.y + e.rect.h;
+        if (rows_.empty() || rows_.back().top != e.rect.y || rows_.back().bottom != bottom) {
+            int max_bottom = (rows_.empty()) ? (bottom) : (std::max(rows_.back().max_bottom, bottom));
+            rows_.push_back({e.rect.y, bottom, max_bottom, {}});
+        }
+        auto &row = rows_.back();
+        e.max_right = e.rect.x + e.rect.w;
+        if (!row.entries.empty()) {
+            e.max_right = std::max(e.max_right, row.entries.back().max_right);
+        }
+        row.entries.push_back(e);
+    }
+}
+
+void LinkTable::clear() {
+    links_.clear();
+    rows_.clear();
+}
+
+const Link *LinkTable::find(int x, int y) const {
+    // topがyより大きい行は対象外なので
+    // そこから上に向かってmax_bottomがy以下になるまで辿る
+    auto row = std::upper_bound(rows_.begin(), rows_.end(), y, [](int y, const Row &r) {
+        return y < r.top;
+    });
+    while (row != rows_.begin()) {
+        --row;
+        if (row->max_bottom <= y) {
+            break;
+        }
+        if (row->bottom <= y) {
+            continue;
+        }
+        auto &entries = row->entries;
+        auto e = std::upper_bound(entries.begin(), entries.end(), x, [](int x, const Entry &e) {
+            return x < e.rect.x;
+        });
+        while (e != entries.begin()) {
+            --e;
+            if (e->max_right <= x) {
+                break;
+            }
+            if (x < e->rect.x + e->rect.w) {
+                return &links_[e->index];
+            }
+        }
+    }
+    return nullptr;
+}
+
+const Link *LinkTable::get(int id) const {
+    // idはappendLinkBeginの順に振られるので昇順に並んでいる
+    auto it = std::lower_bound(links_.begin(), links_.end(), id, [](const Link &l, int id) {
+        return l.id < id;
+    });
+    if (it == links_.end() || it->id != id) {
+        return nullptr;
+    }
+    return &*it;
+}
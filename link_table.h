@@ -0,0 +1,33 @@
+#ifndef LINK_TABLE_H_
+#define LINK_TABLE_H_
+
+#include <vector>
+
+#include "post.h"
+
+class LinkTable {
+    struct Entry {
+        post::Rect rect;
+        int index;
+        // この要素までのx + wの最大値
+        int max_right;
+    };
+    struct Row {
+        int top, bottom;
+        // この行までのbottomの最大値
+        int max_bottom;
+        std::vector<Entry> entries;
+    };
+    private:
+        std::vector<Link> links_;
+        std::vector<Row> rows_;
+    public:
+        LinkTable() {}
+        ~LinkTable() {}
+        void build(const post::Post &post);
+        void clear();
+        const Link *find(int x, int y) const;
+        const Link *get(int id) const;
+};
+
+#endif // LINK_TABLE_H_
@@ -0,0 +1,187 @@
+#ifndef POST_H_
+#define POST_H_
+
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
+
+namespace post {
+    struct Rect {
+        int x, y, w, h;
+        bool operator==(const Rect &l) const {
+            return x == l.x && y == l.y && w == l.w && h == l.h;
+        }
+    };
+
+    struct ColorInt {
+        int r, g, b, a;
+        bool operator==(const ColorInt &l) const {
+            return r == l.r && g == l.g && b == l.b && a == l.a;
+        }
+    };
+
+    using Color = std::variant<ColorInt, std::string>;
+
+    using IntString = std::variant<int, std::string>;
+    using BoolString = std::variant<bool, std::string>;
+
+    struct Attribute {
+        std::filesystem::path font;
+        std::optional<int> height;
+        Color color;
+        BoolString bold, italic, strike, underline, sup, sub;
+        bool inline_, opaque, use_self_alpha, fixed, foreground, is_sstp_marker;
+        std::optional<Rect> clipping;
+        bool operator==(const Attribute &l) const {
+            return font == l.font && height == l.height && color == l.color &&
+                bold == l.bold && italic == l.italic && strike == l.strike &&
+                underline == l.underline && sup == l.sup && sub == l.sub &&
+                inline_ == l.inline_ && opaque == l.opaque &&
+                use_self_alpha == l.use_self_alpha && fixed == l.fixed &&
+                foreground == l.foreground &&
+                is_sstp_marker == l.is_sstp_marker && clipping == l.clipping;
+        }
+    };
+
+    enum class ContentType {
+        Undefined, Text, Image
+    };
+
+    // 属性はRenderInfo毎に1つずつ実体を持ち、chunkからはidで参照する
+    // 種類はごく少ないので探索は線形で十分
+    class AttributeTable {
+        private:
+            std::vector<Attribute> list_;
+        public:
+            int intern(const Attribute &attr) {
+                for (size_t i = 0; i < list_.size(); i++) {
+                    if (list_[i] == attr) {
+                        return i;
+                    }
+                }
+                list_.push_back(attr);
+                return list_.size() - 1;
+            }
+            const Attribute &get(int id) const {
+                return list_[id];
+            }
+    };
+
+    struct Content {
+        ContentType type;
+        // AttributeTableのid
+        int attr;
+        // Post::textのうちこのchunkの範囲
+        size_t offset, length;
+        bool operator==(const Content &l) const {
+            return type == l.type && attr == l.attr && offset == l.offset && length == l.length;
+        }
+    };
+
+    enum class PointType {
+        Absolute, Relative
+    };
+
+    struct Point {
+        PointType type;
+        int value;
+        bool operator==(const Point &l) const {
+            return type == l.type && value == l.value;
+        }
+    };
+
+    struct LinkBegin {
+        int id;
+        bool is_anchor;
+        std::string event;
+        std::vector<std::string> args;
+        bool operator==(const LinkBegin &l) const {
+            return id == l.id && is_anchor == l.is_anchor && event == l.event && args == l.args;
+        }
+    };
+
+    struct LinkEnd {
+        bool operator==(const LinkEnd &l) const {
+            return true;
+        }
+    };
+
+    struct Head {
+        bool valid;
+        Point x, y;
+        std::optional<LinkBegin> link_begin;
+        std::optional<LinkEnd> link_end;
+        bool in_anchor;
+        bool operator==(const Head &l) const {
+            return valid == l.valid && x == l.x && y == l.y && link_begin == l.link_begin && link_end == l.link_end && in_anchor == l.in_anchor;
+        }
+    };
+
+    // chunk毎の要素をそれぞれ別の配列で持つ
+    // 文字列はtextに連結して持ち、伸びるのは常に最後のchunkだけ
+    struct Post {
+        std::vector<Rect> position;
+        std::vector<Content> content;
+        std::vector<Head> head;
+        std::string text;
+        size_t size() const {
+            return position.size();
+        }
+        bool empty() const {
+            return position.empty();
+        }
+        void clear() {
+            position.clear();
+            content.clear();
+            head.clear();
+            text.clear();
+        }
+        void push_back(const Rect &p, ContentType type, int attr, Head h) {
+            position.push_back(p);
+            content.push_back({type, attr, text.length(), 0});
+            head.push_back(std::move(h));
+        }
+        // 先頭からcount個のchunkを捨てる
+        void erase_front(size_t count) {
+            size_t bytes = (count < size()) ? (content[count].offset) : (text.length());
+            position.erase(position.begin(), position.begin() + count);
+            content.erase(content.begin(), content.begin() + count);
+            head.erase(head.begin(), head.begin() + count);
+            text.erase(0, bytes);
+            for (auto &c : content) {
+                c.offset -= bytes;
+            }
+        }
+        std::string_view data(size_t i) const {
+            return std::string_view(text).substr(content[i].offset, content[i].length);
+        }
+        bool operator==(const Post &l) const {
+            return position == l.position && content == l.content && head == l.head && text == l.text;
+        }
+    };
+}
+
+struct LinkContent {
+    bool is_anchor;
+    std::string text;
+    std::string event;
+    std::vector<std::string> args;
+    bool operator==(const LinkContent &l) const {
+        return is_anchor == l.is_anchor && text == l.text && event == l.event && args == l.args;
+    }
+};
+
+struct Link {
+    // LinkBegin::id, -1ならリンク外
+    int id;
+    std::vector<post::Rect> hit_region_list;
+    LinkContent content;
+    bool operator==(const Link &l) const {
+        return id == l.id && hit_region_list == l.hit_region_list && content == l.content;
+    }
+};
+
+#endif // POST_H_
@@ -1,109 +1,149 @@
 #include "render_info.h"
 
 #include <cassert>
+#include <limits>
 
 #include "character.h"
+#include "line_break.h"
 #include "logger.h"
+#include "utf8.h"
 #include "util.h"
 
 namespace {
     constexpr int kLineSpace = 1;
+    // 捨てられるchunkがこれだけ溜まってからまとめて捨てる
+    constexpr size_t kTrimBatch = 64;
+
+    const Link kNoLink = {
+        .id = -1,
+        .hit_region_list = {},
+        .content = {
+            .is_anchor = false,
+            .text = "",
+            .event = "",
+            .args = {},
+        },
+    };
 }
 
-RenderInfo::RenderInfo(Character *parent, int side, std::unique_ptr<FontCache> &font_cache, std::unique_ptr<ImageCache> &image_cache) : parent_(parent), side_(side), balloon_id_(-1), direction_(false), scroll_(0), shown_(false), scale_(100), font_cache_(font_cache), image_cache_(image_cache), origin_x_(0), origin_y_(0), changed_(false) {
+RenderInfo::RenderInfo(Character *parent, int side, std::unique_ptr<FontCache> &font_cache, std::unique_ptr<ImageCache> &image_cache) : parent_(parent), side_(side), balloon_id_(-1), pending_id_(-1), direction_(false), scroll_(0), shown_(false), scale_(100), balloon_width_(0), balloon_height_(0), config_(nullptr), font_cache_(font_cache), image_cache_(image_cache), origin_x_(0), origin_y_(0), valid_rect_({0, 0, 0, 0}), wrap_width_(std::numeric_limits<int>::max()), changed_(false), link_table_dirty_(true), link_id_(-1), next_link_id_(0), scrollback_(0) {
+    default_attr_ = attributes_.intern({
+        .font = "default",
+        .height = std::nullopt,
+        .color = "default",
+        .bold = "default",
+        .italic = "default",
+        .strike = "default",
+        .underline = "default",
+        .sup = "default",
+        .sub = "default",
+        .inline_ = false,
+        .opaque = false,
+        .use_self_alpha = false,
+        .fixed = false,
+        .foreground = false,
+        .is_sstp_marker = false,
+        .clipping = std::nullopt,
+    });
     clear(true);
 }
 
-RenderInfo::~RenderInfo() {}
+RenderInfo::~RenderInfo() {
+    // ImageCacheが先に無くなっていることがある
+    if (!pinned_.empty() && image_cache_) {
+        image_cache_->unpinRelative(pinned_);
+    }
+}
 
 void RenderInfo::reconfigure() {
-    post::Post prev = post_;
+    post::Post prev = std::move(post_);
     clear(true);
     // truly clear
-    post_.data.clear();
-    for (const auto &data : prev.data) {
-        if (data.head.valid) {
+    post_.clear();
+    for (size_t i = 0; i < prev.size(); i++) {
+        auto &head = prev.head[i];
+        auto &content = prev.content[i];
+        if (head.valid) {
             newBuffer(true);
-            post_.data.back().head = data.head;
+            post_.head.back() = std::move(head);
             calculatePosition();
         }
-        else if (data.head.link_begin || data.head.link_end) {
+        else if (head.link_begin || head.link_end) {
             newBuffer(false);
-            post_.data.back().head = data.head;
+            post_.head.back() = std::move(head);
             calculatePosition();
         }
         else {
-            bool continue_flag = (post_.data.back().content.type == post::ContentType::Text && data.content.type == post::ContentType::Text && post_.data.back().content.attr == data.content.attr);
+            bool continue_flag = (post_.content.back().type == post::ContentType::Text && content.type == post::ContentType::Text && post_.content.back().attr == content.attr);
             if (!continue_flag) {
                 newBuffer(false);
                 calculatePosition();
             }
         }
-        post_.data.back().content.attr = data.content.attr;
-        switch (data.content.type) {
+        post_.content.back().attr = content.attr;
+        switch (content.type) {
             case post::ContentType::Text:
-                for (auto s : util::UTF8Split(data.content.data)) {
-                    appendText(s);
-                }
+                layoutText(prev.data(i));
                 break;
             default:
                 // TODO stub
                 break;
         }
     }
+    scrollToBottom();
 }
 
 void RenderInfo::calculatePosition() {
-    if (post_.data.size() == 0) {
+    if (post_.empty()) {
         return;
     }
-    auto &last = post_.data.back();
-    if (post_.data.size() == 1) {
-        last.head.x.value = origin_x_;
-        last.position.x = origin_x_;
+    link_table_dirty_ = true;
+    size_t n = post_.size();
+    auto &position = post_.position.back();
+    auto &head = post_.head.back();
+    if (n == 1) {
+        head.x.value = origin_x_;
+        position.x = origin_x_;
     }
-    else if (last.head.x.type == post::PointType::Absolute) {
-        last.position.x = origin_x_ + last.head.x.value;
+    else if (head.x.type == post::PointType::Absolute) {
+        position.x = origin_x_ + head.x.value;
     }
     else {
-        auto &pos = post_.data[post_.data.size() - 2].position;
-        last.position.x = pos.x + pos.w + last.head.x.value;
+        auto &pos = post_.position[n - 2];
+        position.x = pos.x + pos.w + head.x.value;
     }
-    if (post_.data.size() == 1) {
-        last.head.y.value = origin_y_;
-        last.position.y = origin_y_;
+    if (n == 1) {
+        head.y.value = origin_y_;
+        position.y = origin_y_;
     }
-    else if (last.head.y.type == post::PointType::Absolute) {
-        last.position.y = origin_y_ + last.head.y.value;
+    else if (head.y.type == post::PointType::Absolute) {
+        position.y = origin_y_ + head.y.value;
     }
     else {
-        auto &pos = post_.data[post_.data.size() - 2].position;
-        last.position.y = pos.y + last.head.y.value;
+        auto &pos = post_.position[n - 2];
+        position.y = pos.y + head.y.value;
     }
 }
 
 void RenderInfo::clear(bool initialize) {
     if (initialize) {
-        post_.data.clear();
+        post_.clear();
         newBuffer(true);
     }
     else {
         newBuffer(true);
         setCursorPosition("x", 0, true, MoveUnit::Px);
         setCursorPosition("y", 0, true, MoveUnit::Px);
-        auto last = post_.data.back();
-        post_.data.clear();
-        post_.data.push_back(last);
-    }
-    link_ = {
-        .hit_region_list = {},
-        .content = {
-            .is_anchor = false,
-            .text = "",
-            .event = "",
-            .args = {},
-        },
-    };
+        auto position = post_.position.back();
+        auto content = post_.content.back();
+        auto head = std::move(post_.head.back());
+        post_.clear();
+        post_.push_back(position, content.type, content.attr, std::move(head));
+    }
+    link_table_.clear();
+    link_table_dirty_ = true;
+    link_id_ = -1;
+    chunk_index_.clear();
 }
 
 void RenderInfo::setScale(int scale) {
@@ -111,9 +151,14 @@ void RenderInfo::setScale(int scale) {
         return;
     }
     scale_ = scale;
+    updateBalloonSize();
     change();
 }
 
+void RenderInfo::setScrollback(int lines) {
+    scrollback_ = std::max(lines, 0);
+}
+
 void RenderInfo::setOrigin(int x, int y) {
     if (origin_x_ == x && origin_y_ == y) {
         return;
@@ -138,115 +183,93 @@ void RenderInfo::setWrapPoint(int x) {
 
 void RenderInfo::newBuffer(bool new_line) {
     change();
-    if (post_.data.size() == 0) {
-        post_.data.push_back({
-            .position = {origin_x_, origin_y_, 0, 0},
-            .content = {
-                .type = post::ContentType::Undefined,
-                .data = "",
-                .attr = post::Attribute{
-                    .font = "default",
-                    .height = std::nullopt,
-                    .color = "default",
-                    .bold = "default",
-                    .italic = "default",
-                    .strike = "default",
-                    .underline = "default",
-                    .sup = "default",
-                    .sub = "default",
-                    .inline_ = false,
-                    .opaque = false,
-                    .use_self_alpha = false,
-                    .fixed = false,
-                    .foreground = false,
-                    .is_sstp_marker = false,
-                    .clipping = std::nullopt,
-                }
+    link_table_dirty_ = true;
+    line_breaker_.reset();
+    if (post_.empty()) {
+        post_.push_back({origin_x_, origin_y_, 0, 0}, post::ContentType::Undefined, default_attr_, {
+            .valid = new_line,
+            .x = {
+                .type = post::PointType::Absolute,
+                .value = origin_x_
             },
-            .head = {
-                .valid = new_line,
-                .x = {
-                    .type = post::PointType::Absolute,
-                    .value = origin_x_
-                },
-                .y = {
-                    .type = post::PointType::Absolute,
-                    .value = origin_y_
-                }
+            .y = {
+                .type = post::PointType::Absolute,
+                .value = origin_y_
             }
         });
     }
     else {
-        auto &last = post_.data.back();
-        post_.data.push_back({
-            .position = {last.position.x + last.position.w, last.position.y, 0, 0},
-            .content = {
-                .type = post::ContentType::Undefined,
-                .data = "",
-                .attr = last.content.attr // FIXME init image option
+        auto &last = post_.position.back();
+        post::Rect position = {last.x + last.w, last.y, 0, 0};
+        // FIXME init image option
+        int attr = post_.content.back().attr;
+        post_.push_back(position, post::ContentType::Undefined, attr, {
+            .valid = new_line,
+            .x = {
+                .type = post::PointType::Relative,
+                .value = 0
+            },
+            .y = {
+                .type = post::PointType::Relative,
+                .value = 0
             },
-            .head = {
-                .valid = new_line,
-                .x = {
-                    .type = post::PointType::Relative,
-                    .value = 0
-                },
-                .y = {
-                    .type = post::PointType::Relative,
-                    .value = 0
-                },
-            }
         });
     }
 }
 
 std::unique_ptr<WrapSurface> RenderInfo::getSurface() {
+    updatePin();
     if (balloon_id_ == -1 || !shown_) {
         std::unique_ptr<WrapSurface> invalid;
         return invalid;
     }
     auto filename = util::balloonSide2str(side_, balloon_id_, direction_);
-    auto &info = image_cache_->getRelative(filename);
+    auto info = image_cache_->getRelative(filename);
     if (!info) {
         Logger::log("not found: ", filename);
         std::unique_ptr<WrapSurface> invalid;
         return invalid;
     }
+    if (link_table_dirty_) {
+        link_table_.build(post_);
+        link_table_dirty_ = false;
+    }
     WrapSurface balloon(info.value());
     auto dst = std::make_unique<WrapSurface>(balloon.width(), balloon.height());
     SDL_ClearSurface(dst->surface(), 0, 0, 0, 0);
     SDL_SetSurfaceBlendMode(balloon.surface(), SDL_BLENDMODE_BLEND);
     SDL_BlitSurface(balloon.surface(), nullptr, dst->surface(), nullptr);
 
-    for (const auto &data : post_.data) {
-        if (data.content.data.length() == 0) {
+    // 表示範囲にかかるchunkだけを描く
+    chunk_index_.update(post_);
+    chunk_index_.find(post_, scroll_, scroll_ + (balloon.height() * 100 + scale_ - 1) / scale_, visible_);
+    for (auto i : visible_) {
+        if (post_.content[i].length == 0) {
             continue;
         }
-        auto &font = (font_cache_->get(data.content.attr.font)->font() != nullptr) ? font_cache_->get(data.content.attr.font) : font_cache_->get("default");
+        auto &attr = attributes_.get(post_.content[i].attr);
+        auto data = post_.data(i);
+        auto &position = post_.position[i];
+        auto &font = (font_cache_->get(attr.font)->font() != nullptr) ? font_cache_->get(attr.font) : font_cache_->get("default");
         auto old_size = TTF_GetFontSize(font->font());
         TTF_SetFontSize(font->font(), old_size * scale_ / 100.0);
-        auto &color = data.content.attr.color;
+        auto &color = attr.color;
         post::ColorInt c = {0, 0, 0, 0};
         if (std::holds_alternative<post::ColorInt>(color)) {
             c = std::get<post::ColorInt>(color);
         }
         else {
-            auto s = std::get<std::string>(color);
-            int id = util::balloon2id(balloon_id_, direction_);
+            auto &s = std::get<std::string>(color);
             if (s == "default") {
-                util::to_x(parent_->getInfo(id, "font.color.r", "0"), c.r);
-                util::to_x(parent_->getInfo(id, "font.color.g", "0"), c.g);
-                util::to_x(parent_->getInfo(id, "font.color.b", "0"), c.b);
+                c = config_->font_color;
             }
             else if (s == "disable") {
-                util::to_x(parent_->getInfo(id, "disable.font.color.r", "0"), c.r);
-                util::to_x(parent_->getInfo(id, "disable.font.color.g", "0"), c.g);
-                util::to_x(parent_->getInfo(id, "disable.font.color.b", "0"), c.b);
+                c = config_->disable_font_color;
             }
             c.a = 0xff;
         }
-        SDL_Surface *text = TTF_RenderText_Blended(font->font(), data.content.data.data(), data.content.data.length(), {static_cast<Uint8>(c.r), static_cast<Uint8>(c.g), static_cast<Uint8>(c.b), static_cast<Uint8>(c.a)});
-        SDL_Rect r = {data.position.x * scale_ / 100, (data.position.y - scroll_) * scale_ / 100, text->w * scale_ / 100, text->h * scale_ / 100};
+        SDL_Surface *text = TTF_RenderText_Blended(font->font(), data.data(), data.length(), {static_cast<Uint8>(c.r), static_cast<Uint8>(c.g), static_cast<Uint8>(c.b), static_cast<Uint8>(c.a)});
+        SDL_Rect r = {position.x * scale_ / 100, (position.y - scroll_) * scale_ / 100, text->w * scale_ / 100, text->h * scale_ / 100};
         SDL_BlitSurface(text, nullptr, dst->surface(), &r);
         SDL_DestroySurface(text);
         TTF_SetFontSize(font->font(), old_size);
@@ -255,141 +278,142 @@ std::unique_ptr<WrapSurface> RenderInfo::getSurface() {
 }
 
 void RenderInfo::setID(int id) {
-    int tmp_id = (id / 2) * 2;
+    pending_id_ = (id / 2) * 2;
+    // 読み込みは別スレッドで行い、終わってから反映する
+    image_cache_->requestRelative(util::balloonSide2str(side_, pending_id_, direction_));
+    ready();
+}
+
+bool RenderInfo::ready() {
+    if (pending_id_ == -1) {
+        return true;
+    }
+    int tmp_id = pending_id_;
     auto filename = util::balloonSide2str(side_, tmp_id, direction_);
-    auto &info = image_cache_->getRelative(filename);
+    if (!image_cache_->readyRelative(filename)) {
+        return false;
+    }
+    pending_id_ = -1;
+    auto info = image_cache_->getRelative(filename);
     if (!info) {
         Logger::log("balloon.set:", filename, "not found");
-        return;
+        return true;
     }
     balloon_id_ = tmp_id;
-    id = util::balloon2id(balloon_id_, direction_);
-    int x = 0, y = 0, w = 0, h = 0;
-    std::string value = parent_->getInfo(id, "origin.x", "0");
-    util::to_x(value, x);
+    balloon_width_ = info->width();
+    balloon_height_ = info->height();
+    config_ = parent_->getBalloonConfig(util::balloon2id(balloon_id_, direction_));
+    int x = config_->origin_x, y = config_->origin_y, w, h;
     if (x < 0) {
         x += info->width();
     }
-    value = parent_->getInfo(id, "origin.y", "0");
-    util::to_x(value, y);
     if (y < 0) {
         y += info->height();
     }
     setOrigin(x, y);
 
-    value = parent_->getInfo(id, "validrect.left", "0");
-    util::to_x(value, x);
+    x = config_->validrect_left;
     if (x < 0) {
         x += info->width();
     }
-    value = parent_->getInfo(id, "validrect.top", "0");
-    util::to_x(value, y);
+    y = config_->validrect_top;
     if (y < 0) {
         y += info->height();
     }
-    value = parent_->getInfo(id, "validrect.right", "0");
-    util::to_x(value, w);
+    w = config_->validrect_right;
     if (w <= 0) {
         w += info->width();
     }
     w -= x;
-    value = parent_->getInfo(id, "validrect.bottom", "0");
-    util::to_x(value, h);
+    h = config_->validrect_bottom;
     if (h <= 0) {
         h += info->height();
     }
     h -= y;
     setValidRect(x, y, w, h);
 
-    value = parent_->getInfo(id, "wordwrappoint.x", "0");
-    util::to_x(value, x);
+    x = config_->wordwrappoint_x;
     if (x <= 0) {
         x += info->width();
     }
     setWrapPoint(x);
     reconfigure();
     change();
+    return true;
 }
 
 void RenderInfo::setDirection(bool direction) {
     if (direction_ != direction) {
         direction_ = direction;
-        setID(balloon_id_);
+        setID((pending_id_ != -1) ? (pending_id_) : (balloon_id_));
         change();
     }
 }
 
-void RenderInfo::scroll(int diff) {
-    auto filename = util::balloonSide2str(side_, balloon_id_, direction_);
-    auto &info = image_cache_->getRelative(filename);
-    if (!info) {
+void RenderInfo::reload() {
+    if (pending_id_ != -1 || balloon_id_ == -1) {
         return;
     }
-    int h_max = 0;
-    for (auto &data : post_.data) {
-        h_max = std::max(h_max, data.position.y + data.position.h);
+    setID(balloon_id_);
+}
+
+bool RenderInfo::uses(const std::filesystem::path &path) const {
+    if (balloon_id_ == -1) {
+        return false;
     }
+    return path.filename() == util::balloonSide2str(side_, balloon_id_, direction_);
+}
+
+void RenderInfo::scroll(int diff) {
+    if (balloon_id_ == -1) {
+        return;
+    }
+    chunk_index_.update(post_);
+    int h_max = chunk_index_.bottom(post_);
     auto &font = font_cache_->get("default");
-    scroll_ -= diff * (TTF_GetFontHeight(font->font()) + kLineSpace);
-    scroll_ = std::min(scroll_, h_max - info->height());
+    scroll_ -= diff * (font->metrics().height() + kLineSpace);
+    scroll_ = std::min(scroll_, h_max - balloon_height_);
     scroll_ = std::max(scroll_, 0);
     change();
 }
 
 void RenderInfo::hit(int x, int y) {
-    std::vector<post::Rect> list;
-    LinkContent content;
-    bool hit = false;
-    bool in_link = false;
+    if (link_table_dirty_) {
+        link_table_.build(post_);
+        link_table_dirty_ = false;
+    }
     x = x * 100.0 / scale_;
     y = y * 100.0 / scale_;
-    for (auto &data : post_.data) {
-        if (data.head.link_begin) {
-            auto begin = data.head.link_begin.value();
-            content.is_anchor = begin.is_anchor;
-            content.event = begin.event;
-            content.args = begin.args;
-            in_link = true;
-        }
-        if (in_link) {
-            auto &p = data.position;
-            post::Rect r = {
-                p.x * scale_ / 100.0,
-                p.y * scale_ / 100.0,
-                p.w * scale_ / 100.0,
-                p.h * scale_ / 100.0,
-            };
-            list.push_back(r);
-            if (data.content.type == post::ContentType::Text) {
-                content.text += data.content.data;
-            }
-            hit = hit || (x >= p.x && x < p.x + p.w && y >= (p.y - scroll_) && y < (p.y - scroll_) + p.h);
-        }
-        if (data.head.link_end) {
-            in_link = false;
-            if (hit) {
-                break;
-            }
-            list.clear();
-            content = {
-                .is_anchor = false,
-                .text = "",
-                .event = "",
-                .args = {},
-            };
-        }
-    }
-    if (list != link_.hit_region_list) {
-        link_.hit_region_list = list;
-        link_.content = content;
+    auto *link = link_table_.find(x, y + scroll_);
+    int id = (link != nullptr) ? (link->id) : (-1);
+    if (id != link_id_) {
+        link_id_ = id;
         change();
     }
 }
 
+const Link &RenderInfo::getLink() const {
+    auto *link = link_table_.get(link_id_);
+    if (link == nullptr) {
+        return kNoLink;
+    }
+    return *link;
+}
+
 std::vector<post::Rect> RenderInfo::getHitRegion() const {
-    auto ret = link_.hit_region_list;
-    for (auto &r : ret) {
-        r.y -= scroll_ * scale_ / 100.0;
+    auto *link = link_table_.get(link_id_);
+    if (link == nullptr) {
+        return {};
+    }
+    std::vector<post::Rect> ret;
+    ret.reserve(link->hit_region_list.size());
+    for (auto &p : link->hit_region_list) {
+        ret.push_back({
+            static_cast<int>(p.x * scale_ / 100.0),
+            static_cast<int>((p.y - scroll_) * scale_ / 100.0),
+            static_cast<int>(p.w * scale_ / 100.0),
+            static_cast<int>(p.h * scale_ / 100.0),
+        });
     }
     return ret;
 }
@@ -398,83 +422,209 @@ void RenderInfo::appendText(const std::string &text) {
     if (text.empty()) {
         return;
     }
-    if (balloon_id_ == -1) {
+    if (balloon_id_ == -1 && pending_id_ == -1) {
         setID(0);
     }
+    layoutText(text);
+    scrollToBottom();
+}
+
+void RenderInfo::layoutText(std::string_view text) {
+    if (text.empty()) {
+        return;
+    }
     change();
-    auto &last = post_.data.back();
-    auto &font = font_cache_->get(last.content.attr.font) ? font_cache_->get(last.content.attr.font) : font_cache_->get("default");
-    std::string tmp;
-    int width;
-    switch (last.content.type) {
-        case post::ContentType::Image:
-            newBuffer(false);
-        case post::ContentType::Undefined:
-            post_.data.back().content.type = post::ContentType::Text;
-            post_.data.back().content.data = text;
-            calculatePosition();
-            TTF_MeasureString(font->font(), text.data(), text.length(), 0, &width, nullptr);
-            post_.data.back().position.w = width;
-            post_.data.back().position.h = TTF_GetFontHeight(font->font());
-            break;
-        case post::ContentType::Text:
-            tmp = last.content.data + text;
-            TTF_MeasureString(font->font(), tmp.data(), tmp.length(), 0, &width, nullptr);
-            if (width < wrap_width_ - origin_x_) {
-                last.content.data = tmp;
-                last.position.w = width;
+    link_table_dirty_ = true;
+    if (post_.content.back().type == post::ContentType::Image) {
+        newBuffer(false);
+    }
+    auto &attr = attributes_.get(post_.content.back().attr);
+    auto &font = font_cache_->get(attr.font) ? font_cache_->get(attr.font) : font_cache_->get("default");
+    auto &metrics = font->metrics();
+    size_t last = post_.size() - 1;
+    if (post_.content[last].type == post::ContentType::Undefined) {
+        post_.content[last].type = post::ContentType::Text;
+        calculatePosition();
+        post_.position[last].w = 0;
+        post_.position[last].h = metrics.height();
+    }
+    // 計測済みの幅に1文字ずつ足していく
+    int width = 0;
+    char32_t prev = 0;
+    // 行の途中から状態を作り直す
+    auto rescan = [&](std::string_view data) {
+        line_breaker_.reset();
+        width = 0;
+        prev = 0;
+        for (auto &cp : utf8::view(data)) {
+            line_breaker_.feed(cp.code, cp.offset, width);
+            width += metrics.kerning(prev, cp.code) + metrics.advance(cp.code);
+            prev = cp.code;
+        }
+    };
+    if (post_.content[last].length > 0 && !line_breaker_.valid()) {
+        rescan(post_.data(last));
+    }
+    else {
+        width = post_.position[last].w;
+        prev = utf8::last(post_.data(last)).code;
+    }
+    // 最後のchunkは常にtextの末尾にあるので先に全部追加しておき
+    // 折り返しはchunkの範囲を分けるだけで済ませる
+    size_t start = post_.text.length();
+    post_.text.append(text);
+    post_.content[last].length += text.length();
+    for (auto &cp : utf8::view(text)) {
+        char32_t c = cp.code;
+        size_t offset = start + cp.offset - post_.content[last].offset;
+        bool can_break = line_breaker_.feed(c, offset, width);
+        int w = width + metrics.kerning(prev, c) + metrics.advance(c);
+        if (w >= wrap_width_ - origin_x_ && offset > 0) {
+            // cの直前で折り返せなければ直近の折り返し位置まで戻る
+            // それも無く、cが行頭禁則文字ならぶら下げる
+            size_t cut = offset;
+            int cut_width = width;
+            if (!can_break) {
+                if (line_breaker_.offset() > 0) {
+                    cut = line_breaker_.offset();
+                    cut_width = line_breaker_.width();
+                }
+                else if (line_break::isProhibitedAtLineStart(line_break::classOf(c))) {
+                    cut = std::string::npos;
+                }
             }
-            else {
+            if (cut != std::string::npos) {
+                size_t begin = post_.content[last].offset;
+                size_t length = post_.content[last].length;
+                post_.content[last].length = cut;
+                post_.position[last].w = cut_width;
                 newBuffer(false);
                 setCursorPosition("x", 0, true, MoveUnit::Px);
                 setCursorPosition("y", 1, false, MoveUnit::Lh);
-                post_.data.back().content.type = post::ContentType::Text;
-                post_.data.back().content.data = text;
-                TTF_MeasureString(font->font(), text.data(), text.length(), 0, &width, nullptr);
-                post_.data.back().position.w = width;
-                post_.data.back().position.h = TTF_GetFontHeight(font->font());
+                last = post_.size() - 1;
+                post_.content[last].type = post::ContentType::Text;
+                post_.content[last].offset = begin + cut;
+                post_.content[last].length = length - cut;
+                post_.position[last].h = metrics.height();
+                rescan(post_.data(last).substr(0, offset - cut));
+                line_breaker_.feed(c, offset - cut, width);
+                w = width + metrics.kerning(prev, c) + metrics.advance(c);
             }
-            break;
-        default:
-            break;
+        }
+        width = w;
+        prev = c;
+    }
+    post_.position[last].w = width;
+}
+
+void RenderInfo::scrollToBottom() {
+    if (balloon_id_ == -1) {
+        return;
+    }
+    // 確定したchunkの下端は索引が持っているので
+    // 毎回全体を見る必要は無い
+    chunk_index_.update(post_);
+    int h_max = chunk_index_.bottom(post_);
+    scroll_ = std::max(0, h_max - balloon_height_);
+    trimScrollback();
+}
+
+void RenderInfo::updateBalloonSize() {
+    if (balloon_id_ == -1) {
+        return;
     }
-    // scroll
     auto filename = util::balloonSide2str(side_, balloon_id_, direction_);
-    auto &info = image_cache_->getRelative(filename);
+    auto info = image_cache_->getRelative(filename);
     if (!info) {
-        Logger::log("not found: ", filename);
-        std::unique_ptr<WrapSurface> invalid;
         return;
     }
-    int h_max = 0;
-    for (auto &data : post_.data) {
-        h_max = std::max(h_max, data.position.y + data.position.h);
+    balloon_width_ = info->width();
+    balloon_height_ = info->height();
+}
+
+void RenderInfo::updatePin() {
+    std::filesystem::path path;
+    if (balloon_id_ != -1 && shown_) {
+        path = util::balloonSide2str(side_, balloon_id_, direction_);
+    }
+    if (path == pinned_) {
+        return;
+    }
+    if (!pinned_.empty()) {
+        image_cache_->unpinRelative(pinned_);
+    }
+    if (!path.empty()) {
+        image_cache_->pinRelative(path);
+    }
+    pinned_ = path;
+}
+
+void RenderInfo::trimScrollback() {
+    if (scrollback_ == 0) {
+        return;
+    }
+    auto &font = font_cache_->get("default");
+    int limit = scroll_ - scrollback_ * (font->metrics().height() + kLineSpace);
+    if (limit <= 0) {
+        return;
+    }
+    // 先頭から続けてlimitより上にあるchunkを捨てる
+    // 最後のchunkは書き込み中なので残す
+    // リンクの途中では切らず、LinkBeginからLinkEndまでをまとめて捨てる
+    size_t count = 0;
+    bool in_link = false;
+    for (size_t i = 0; count < kTrimBatch && i + 1 < post_.size(); i++) {
+        auto &p = post_.position[i];
+        if (p.y + p.h > limit) {
+            break;
+        }
+        auto &head = post_.head[i];
+        if (head.link_begin) {
+            in_link = true;
+        }
+        if (head.link_end) {
+            in_link = false;
+        }
+        if (!in_link) {
+            count = i + 1;
+        }
     }
-    scroll_ = std::max(0, h_max - info->height());
+    if (count < kTrimBatch) {
+        return;
+    }
+    post_.erase_front(count);
+    // 作り直したときに残りの先頭から始められるようにする
+    post_.head.front().valid = true;
+    chunk_index_.clear();
+    link_table_dirty_ = true;
+    change();
 }
 
 void RenderInfo::appendLinkBegin(bool is_anchor, const std::string &event, const std::vector<std::string> &args) {
     newBuffer(false);
-    auto &last = post_.data.back();
+    auto &last = post_.head.back();
     post::LinkBegin link = {
+        .id = next_link_id_++,
         .is_anchor = is_anchor,
         .event = event,
         .args = args,
     };
-    last.head.link_begin = std::make_optional<post::LinkBegin>(link);
+    last.link_begin = std::make_optional<post::LinkBegin>(link);
 }
 
 void RenderInfo::appendLinkEnd() {
-    auto &last = post_.data.back();
+    auto &last = post_.head.back();
     post::LinkEnd link;
-    last.head.link_end = std::make_optional<post::LinkEnd>(link);
+    last.link_end = std::make_optional<post::LinkEnd>(link);
+    link_table_dirty_ = true;
 }
 
 void RenderInfo::setCursorPosition(std::string axis, double value, bool is_absolute, MoveUnit unit) {
-    auto &last = post_.data.back();
-    auto &font = font_cache_->get(last.content.attr.font) ? font_cache_->get(last.content.attr.font) : font_cache_->get("default");
-    int width;
-    TTF_MeasureString(font->font(), "0", 1, 0, &width, nullptr);
+    auto &last = post_.head.back();
+    auto &attr = attributes_.get(post_.content.back().attr);
+    auto &font = font_cache_->get(attr.font) ? font_cache_->get(attr.font) : font_cache_->get("default");
+    auto &metrics = font->metrics();
+    int width = metrics.emWidth();
     switch (unit) {
         case MoveUnit::Px:
             value = static_cast<int>(value);
@@ -484,7 +634,7 @@ void RenderInfo::setCursorPosition(std::string axis, double value, bool is_absol
                 value *= width;
             }
             else if (axis == "y") {
-                value *= TTF_GetFontHeight(font->font());
+                value *= metrics.height();
             }
             break;
         case MoveUnit::Lh:
@@ -492,26 +642,26 @@ void RenderInfo::setCursorPosition(std::string axis, double value, bool is_absol
                 value *= width;
             }
             else if (axis == "y") {
-                value *= TTF_GetFontHeight(font->font()) + kLineSpace;
+                value *= metrics.height() + kLineSpace;
             }
             break;
     }
     if (axis == "x") {
-        last.head.x.value = value;
+        last.x.value = value;
         if (is_absolute) {
-            last.head.x.type = post::PointType::Absolute;
+            last.x.type = post::PointType::Absolute;
         }
         else {
-            last.head.x.type = post::PointType::Relative;
+            last.x.type = post::PointType::Relative;
         }
     }
     else if (axis == "y") {
-        last.head.y.value = value;
+        last.y.value = value;
         if (is_absolute) {
-            last.head.y.type = post::PointType::Absolute;
+            last.y.type = post::PointType::Absolute;
         }
         else {
-            last.head.y.type = post::PointType::Relative;
+            last.y.type = post::PointType::Relative;
         }
     }
     calculatePosition();
@@ -3,148 +3,37 @@
 
 #include <filesystem>
 #include <memory>
+#include <string_view>
 #include <variant>
 #include <vector>
 
-#include "texture.h"
+#include "balloon_config.h"
+#include "chunk_index.h"
+#include "line_break.h"
+#include "link_table.h"
 #include "misc.h"
+#include "post.h"
+#include "texture.h"
 
 class Character;
 
-namespace post {
-    struct Rect {
-        int x, y, w, h;
-        bool operator==(const Rect &l) const {
-            return x == l.x && y == l.y && w == l.w && h == l.h;
-        }
-    };
-
-    struct ColorInt {
-        int r, g, b, a;
-        bool operator==(const ColorInt &l) const {
-            return r == l.r && g == l.g && b == l.b && a == l.a;
-        }
-    };
-
-    using Color = std::variant<ColorInt, std::string>;
-
-    using IntString = std::variant<int, std::string>;
-    using BoolString = std::variant<bool, std::string>;
-
-    struct Attribute {
-        std::filesystem::path font;
-        std::optional<int> height;
-        Color color;
-        BoolString bold, italic, strike, underline, sup, sub;
-        bool inline_, opaque, use_self_alpha, fixed, foreground, is_sstp_marker;
-        std::optional<Rect> clipping;
-        bool operator==(const Attribute &l) const {
-            return font == l.font && height == l.height && color == l.color &&
-                bold == l.bold && italic == l.italic && strike == l.strike &&
-                underline == l.underline && sup == l.sup && sub == l.sub &&
-                inline_ == l.inline_ && opaque == l.opaque &&
-                use_self_alpha == l.use_self_alpha && fixed == l.fixed &&
-                foreground == l.foreground &&
-                is_sstp_marker == l.is_sstp_marker && clipping == l.clipping;
-        }
-    };
-
-    enum class ContentType {
-        Undefined, Text, Image
-    };
-
-    struct Content {
-        ContentType type;
-        std::string data;
-        Attribute attr;
-        bool operator==(const Content &l) const {
-            return type == l.type && data == l.data && attr == l.attr;
-        }
-    };
-
-    enum class PointType {
-        Absolute, Relative
-    };
-
-    struct Point {
-        PointType type;
-        int value;
-        bool operator==(const Point &l) const {
-            return type == l.type && value == l.value;
-        }
-    };
-
-    struct LinkBegin {
-        bool is_anchor;
-        std::string event;
-        std::vector<std::string> args;
-        bool operator==(const LinkBegin &l) const {
-            return is_anchor == l.is_anchor && event == l.event && args == l.args;
-        }
-    };
-
-    struct LinkEnd {
-        bool operator==(const LinkEnd &l) const {
-            return true;
-        }
-    };
-
-    struct Head {
-        bool valid;
-        Point x, y;
-        std::optional<LinkBegin> link_begin;
-        std::optional<LinkEnd> link_end;
-        bool in_anchor;
-        bool operator==(const Head &l) const {
-            return valid == l.valid && x == l.x && y == l.y && link_begin == l.link_begin && link_end == l.link_end && in_anchor == l.in_anchor;
-        }
-    };
-
-    struct Data {
-        Rect position;
-        Content content;
-        Head head;
-        bool operator==(const Data &l) const {
-            return position == l.position && content == l.content && head == l.head;
-        }
-    };
-
-    struct Post {
-        std::vector<Data> data;
-        bool operator==(const Post &l) const {
-            return data == l.data;
-        }
-    };
-}
-
-struct LinkContent {
-    bool is_anchor;
-    std::string text;
-    std::string event;
-    std::vector<std::string> args;
-    bool operator==(const LinkContent &l) const {
-        return is_anchor == l.is_anchor && text == l.text && event == l.event && args == l.args;
-    }
-};
-
-struct Link {
-    std::vector<post::Rect> hit_region_list;
-    LinkContent content;
-    bool operator==(const Link &l) const {
-        return hit_region_list == l.hit_region_list && content == l.content;
-    }
-};
-
 class RenderInfo {
     private:
         Character *parent_;
         int side_;
         int balloon_id_;
+        // 画像の読み込みを待っているid
+        int pending_id_;
         bool direction_;
         int scroll_;
         bool shown_;
         int scale_;
+        // setIDの時点での吹き出し画像の大きさ
+        int balloon_width_, balloon_height_;
+        const BalloonConfig *config_;
         post::Post post_;
+        post::AttributeTable attributes_;
+        int default_attr_;
 
         std::unique_ptr<FontCache> &font_cache_;
         std::unique_ptr<ImageCache> &image_cache_;
@@ -152,10 +41,26 @@ class RenderInfo {
         Rect valid_rect_;
         int wrap_width_;
         bool changed_;
-        Link link_;
+        LinkTable link_table_;
+        bool link_table_dirty_;
+        int link_id_;
+        int next_link_id_;
+        LineBreaker line_breaker_;
+        ChunkIndex chunk_index_;
+        // 描画するchunkのindex
+        std::vector<size_t> visible_;
+        // 表示範囲より上に残しておく行数、0なら無制限
+        int scrollback_;
+        // ImageCacheから追い出されないようにしている画像
+        std::filesystem::path pinned_;
 
         void reconfigure();
         void calculatePosition();
+        void layoutText(std::string_view text);
+        void scrollToBottom();
+        void updateBalloonSize();
+        void trimScrollback();
+        void updatePin();
     public:
         RenderInfo(Character *parent, int side, std::unique_ptr<FontCache> &font_cache, std::unique_ptr<ImageCache> &image_cache);
         ~RenderInfo();
@@ -166,19 +71,24 @@ class RenderInfo {
         }
 
         void setID(int id);
+        // 待っていた吹き出し画像が読み込めていれば反映する
+        // まだならfalse
+        bool ready();
         void setDirection(bool direction);
+        // 吹き出し画像や設定が変わったときに作り直す
+        void reload();
+        bool uses(const std::filesystem::path &path) const;
         void scroll(int diff);
         void hit(int x, int y);
         std::vector<post::Rect> getHitRegion() const;
-        Link getLink() const {
-            return link_;
-        }
+        const Link &getLink() const;
         void show() {
             shown_ = true;
             change();
         }
         void hide() {
             shown_ = false;
+            updatePin();
             change();
         }
         void update() {
@@ -192,6 +102,7 @@ class RenderInfo {
         }
         void clear(bool initialize);
         void setScale(int scale);
+        void setScrollback(int lines);
         void setOrigin(int x, int y);
         void setValidRect(int x, int y, int w, int h);
         void setWrapPoint(int x);
@@ -0,0 +1,350 @@
+#include "resample.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#include "thread_pool.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define RESAMPLE_USE_X86 1
+#endif // x86
+
+namespace {
+    // 1つの仕事で処理する行数
+    constexpr int kBandRows = 16;
+
+    double sinc(double x) {
+        if (x == 0) {
+            return 1;
+        }
+        x *= M_PI;
+        return std::sin(x) / x;
+    }
+
+    double support(resample::Filter filter) {
+        switch (filter) {
+            case resample::Filter::Linear:
+                return 1;
+            case resample::Filter::Lanczos3:
+                return 3;
+            default:
+                return 2;
+        }
+    }
+
+    double kernel(resample::Filter filter, double x) {
+        x = std::abs(x);
+        switch (filter) {
+            case resample::Filter::Linear:
+                return (x < 1) ? (1 - x) : (0);
+            case resample::Filter::Lanczos3:
+                return (x < 3) ? (sinc(x) * sinc(x / 3)) : (0);
+            default:
+                // Catmull-Rom
+                if (x < 1) {
+                    return (1.5 * x - 2.5) * x * x + 1;
+                }
+                if (x < 2) {
+                    return ((-0.5 * x + 2.5) * x - 4) * x + 2;
+                }
+                return 0;
+        }
+    }
+
+    // 出力の各画素が入力のbegin[i]からtaps個の画素をweightで足したものになる
+    // tapsは全て同じにしておき、範囲外の分は端の画素に寄せる
+    struct Weights {
+        int taps;
+        std::vector<int> begin;
+        std::vector<float> weight;
+    };
+
+    Weights computeWeights(int src, int dst, resample::Filter filter) {
+        double scale = static_cast<double>(dst) / src;
+        // 縮小するときはその分だけ広い範囲を見る
+        double stretch = std::max(1.0, 1.0 / scale);
+        double radius = support(filter) * stretch;
+        Weights w;
+        w.taps = std::min(src, 2 * static_cast<int>(std::ceil(radius)) + 1);
+        w.begin.resize(dst);
+        w.weight.assign(static_cast<size_t>(dst) * w.taps, 0);
+        for (int i = 0; i < dst; i++) {
+            double center = (i + 0.5) / scale - 0.5;
+            int first = static_cast<int>(std::floor(center - radius)) + 1;
+            int begin = std::clamp(first, 0, src - w.taps);
+            float *k = w.weight.data() + static_cast<size_t>(i) * w.taps;
+            double sum = 0;
+            for (int j = first; j <= static_cast<int>(std::ceil(center + radius)); j++) {
+                double v = kernel(filter, (j - center) / stretch);
+                if (v == 0) {
+                    continue;
+                }
+                int slot = std::clamp(j, 0, src - 1) - begin;
+                if (slot < 0 || slot >= w.taps) {
+                    continue;
+                }
+                k[slot] += v;
+                sum += v;
+            }
+            if (sum != 0) {
+                for (int t = 0; t < w.taps; t++) {
+                    k[t] /= sum;
+                }
+            }
+            w.begin[i] = begin;
+        }
+        return w;
+    }
+
+    void premultiply(const unsigned char *src, float *dst, int w) {
+        for (int x = 0; x < w; x++) {
+            float a = src[4 * x + 3];
+            float f = a / 255.0f;
+            dst[4 * x + 0] = src[4 * x + 0] * f;
+            dst[4 * x + 1] = src[4 * x + 1] * f;
+            dst[4 * x + 2] = src[4 * x + 2] * f;
+            dst[4 * x + 3] = a;
+        }
+    }
+
+    void unpremultiply(const float *src, unsigned char *dst, int w) {
+        for (int x = 0; x < w; x++) {
+            const float *p = src + 4 * x;
+            float a = std::clamp(p[3], 0.0f, 255.0f);
+            unsigned char *d = dst + 4 * x;
+            if (a < 0.5f) {
+                d[0] = d[1] = d[2] = d[3] = 0;
+                continue;
+            }
+            float f = 255.0f / a;
+            for (int c = 0; c < 3; c++) {
+                d[c] = static_cast<unsigned char>(std::clamp(p[c] * f, 0.0f, 255.0f) + 0.5f);
+            }
+            d[3] = static_cast<unsigned char>(a + 0.5f);
+        }
+    }
+
+    void horizontalScalar(const float *src, float *dst, int dst_w, const Weights &w) {
+        for (int x = 0; x < dst_w; x++) {
+            const float *p = src + 4 * w.begin[x];
+            const float *k = w.weight.data() + static_cast<size_t>(x) * w.taps;
+            float acc[4] = {0, 0, 0, 0};
+            for (int t = 0; t < w.taps; t++) {
+                for (int c = 0; c < 4; c++) {
+                    acc[c] += k[t] * p[4 * t + c];
+                }
+            }
+            memcpy(dst + 4 * x, acc, sizeof(acc));
+        }
+    }
+
+    // srcのtaps行をkで足してdstのn個に書く
+    void verticalScalar(const float *const *rows, const float *k, int taps, float *dst, int n, int begin) {
+        for (int i = begin; i < n; i++) {
+            float acc = 0;
+            for (int t = 0; t < taps; t++) {
+                acc += k[t] * rows[t][i];
+            }
+            dst[i] = acc;
+        }
+    }
+
+    void verticalScalar(const float *const *rows, const float *k, int taps, float *dst, int n) {
+        verticalScalar(rows, k, taps, dst, n, 0);
+    }
+
+#if defined(RESAMPLE_USE_X86)
+    // 1画素のRGBAがちょうど4つのfloatになる
+    __attribute__((target("sse2")))
+    void horizontalSSE2(const float *src, float *dst, int dst_w, const Weights &w) {
+        for (int x = 0; x < dst_w; x++) {
+            const float *p = src + 4 * w.begin[x];
+            const float *k = w.weight.data() + static_cast<size_t>(x) * w.taps;
+            __m128 acc = _mm_setzero_ps();
+            for (int t = 0; t < w.taps; t++) {
+                acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(k[t]), _mm_loadu_ps(p + 4 * t)));
+            }
+            _mm_storeu_ps(dst + 4 * x, acc);
+        }
+    }
+
+    __attribute__((target("sse2")))
+    void verticalSSE2(const float *const *rows, const float *k, int taps, float *dst, int n) {
+        int i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m128 acc = _mm_setzero_ps();
+            for (int t = 0; t < taps; t++) {
+                acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(k[t]), _mm_loadu_ps(rows[t] + i)));
+            }
+            _mm_storeu_ps(dst + i, acc);
+        }
+        verticalScalar(rows, k, taps, dst, n, i);
+    }
+
+    __attribute__((target("avx2,fma")))
+    void verticalAVX2(const float *const *rows, const float *k, int taps, float *dst, int n) {
+        int i = 0;
+        for (; i + 16 <= n; i += 16) {
+            __m256 acc0 = _mm256_setzero_ps();
+            __m256 acc1 = _mm256_setzero_ps();
+            for (int t = 0; t < taps; t++) {
+                __m256 kt = _mm256_set1_ps(k[t]);
+                acc0 = _mm256_fmadd_ps(kt, _mm256_loadu_ps(rows[t] + i), acc0);
+                acc1 = _mm256_fmadd_ps(kt, _mm256_loadu_ps(rows[t] + i + 8), acc1);
+            }
+            _mm256_storeu_ps(dst + i, acc0);
+            _mm256_storeu_ps(dst + i + 8, acc1);
+        }
+        verticalScalar(rows, k, taps, dst, n, i);
+    }
+
+    using HorizontalFunc = void (*)(const float *, float *, int, const Weights &);
+
+    HorizontalFunc selectHorizontal() {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("sse2")) {
+            return horizontalSSE2;
+        }
+        return horizontalScalar;
+    }
+
+    const HorizontalFunc horizontal = selectHorizontal();
+
+    using VerticalFunc = void (*)(const float *const *, const float *, int, float *, int);
+
+    VerticalFunc selectVertical() {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+            return verticalAVX2;
+        }
+        if (__builtin_cpu_supports("sse2")) {
+            return verticalSSE2;
+        }
+        return verticalScalar;
+    }
+
+    const VerticalFunc vertical = selectVertical();
+#else
+    const auto horizontal = static_cast<void (*)(const float *, float *, int, const Weights &)>(horizontalScalar);
+    const auto vertical = static_cast<void (*)(const float *const *, const float *, int, float *, int)>(verticalScalar);
+#endif // RESAMPLE_USE_X86
+
+    void forEachBand(ThreadPool *pool, int rows, auto &&f) {
+        int bands = (rows + kBandRows - 1) / kBandRows;
+        auto band = [&](int i) {
+            int begin = i * kBandRows;
+            f(begin, std::min(rows, begin + kBandRows));
+        };
+        if (pool == nullptr) {
+            for (int i = 0; i < bands; i++) {
+                band(i);
+            }
+        }
+        else {
+            pool->parallelFor(bands, band);
+        }
+    }
+
+    std::vector<unsigned char> separable(const unsigned char *src, int src_w, int src_h, int dst_w, int dst_h, resample::Filter filter, ThreadPool *pool) {
+        Weights wx = computeWeights(src_w, dst_w, filter);
+        Weights wy = computeWeights(src_h, dst_h, filter);
+        size_t stride = 4 * static_cast<size_t>(dst_w);
+        // 横方向だけ済ませたもの
+        std::vector<float> tmp(stride * src_h);
+        forEachBand(pool, src_h, [&](int begin, int end) {
+            std::vector<float> row(4 * static_cast<size_t>(src_w));
+            for (int y = begin; y < end; y++) {
+                premultiply(src + 4 * static_cast<size_t>(src_w) * y, row.data(), src_w);
+                horizontal(row.data(), tmp.data() + stride * y, dst_w, wx);
+            }
+        });
+        std::vector<unsigned char> dst(stride * dst_h);
+        forEachBand(pool, dst_h, [&](int begin, int end) {
+            std::vector<float> row(stride);
+            std::vector<const float *> rows(wy.taps);
+            for (int y = begin; y < end; y++) {
+                for (int t = 0; t < wy.taps; t++) {
+                    rows[t] = tmp.data() + stride * (wy.begin[y] + t);
+                }
+                vertical(rows.data(), wy.weight.data() + static_cast<size_t>(y) * wy.taps, wy.taps, row.data(), stride);
+                unpremultiply(row.data(), dst.data() + stride * y, dst_w);
+            }
+        });
+        return dst;
+    }
+
+    // Scale2x(EPX)で2倍にする、輪郭の角度を保ったまま拡大できる
+    std::vector<unsigned char> scale2x(const unsigned char *src, int w, int h, ThreadPool *pool) {
+        std::vector<unsigned char> dst(16 * static_cast<size_t>(w) * h);
+        auto at = [&](int x, int y) {
+            uint32_t v;
+            memcpy(&v, src + 4 * (static_cast<size_t>(std::clamp(y, 0, h - 1)) * w + std::clamp(x, 0, w - 1)), 4);
+            return v;
+        };
+        forEachBand(pool, h, [&](int begin, int end) {
+            for (int y = begin; y < end; y++) {
+                uint32_t *d0 = reinterpret_cast<uint32_t *>(dst.data()) + static_cast<size_t>(2 * y) * (2 * w);
+                uint32_t *d1 = d0 + 2 * w;
+                for (int x = 0; x < w; x++) {
+                    uint32_t b = at(x, y - 1), d = at(x - 1, y), e = at(x, y), f = at(x + 1, y), hh = at(x, y + 1);
+                    d0[2 * x] = (d == b && b != f && d != hh) ? (d) : (e);
+                    d0[2 * x + 1] = (b == f && b != d && f != hh) ? (f) : (e);
+                    d1[2 * x] = (d == hh && d != b && hh != f) ? (d) : (e);
+                    d1[2 * x + 1] = (hh == f && d != hh && b != f) ? (f) : (e);
+                }
+            }
+        });
+        return dst;
+    }
+}
+
+namespace resample {
+    Filter parse(const std::string &name) {
+        if (name == "linear") {
+            return Filter::Linear;
+        }
+        if (name == "bicubic") {
+            return Filter::Bicubic;
+        }
+        if (name == "pixelart") {
+            return Filter::PixelArt;
+        }
+        return Filter::Lanczos3;
+    }
+
+    const char *name(Filter filter) {
+        switch (filter) {
+            case Filter::Linear:
+                return "linear";
+            case Filter::Bicubic:
+                return "bicubic";
+            case Filter::PixelArt:
+                return "pixelart";
+            default:
+                return "lanczos3";
+        }
+    }
+
+    std::vector<unsigned char> resize(const unsigned char *src, int src_w, int src_h, int dst_w, int dst_h, Filter filter, ThreadPool *pool) {
+        if (src_w <= 0 || src_h <= 0 || dst_w <= 0 || dst_h <= 0) {
+            return std::vector<unsigned char>(4 * static_cast<size_t>(std::max(dst_w, 0)) * std::max(dst_h, 0), 0);
+        }
+        if (filter != Filter::PixelArt || (dst_w <= src_w && dst_h <= src_h)) {
+            return separable(src, src_w, src_h, dst_w, dst_h, (filter == Filter::PixelArt) ? (Filter::Bicubic) : (filter), pool);
+        }
+        // 目的の大きさ以上になるまで2倍にしてから縮める
+        std::vector<unsigned char> buffer;
+        const unsigned char *p = src;
+        int w = src_w, h = src_h;
+        while (w < dst_w || h < dst_h) {
+            buffer = scale2x(p, w, h, pool);
+            p = buffer.data();
+            w *= 2;
+            h *= 2;
+        }
+        return separable(p, w, h, dst_w, dst_h, Filter::Bicubic, pool);
+    }
+}
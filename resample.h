@@ -0,0 +1,24 @@
+#ifndef RESAMPLE_H_
+#define RESAMPLE_H_
+
+#include <string>
+#include <vector>
+
+class ThreadPool;
+
+// ABGR8888(byte順でR,G,B,A)の画像の拡大縮小
+// 計算はpremultiplied alphaで行うので透明な部分の色は結果に混ざらない
+namespace resample {
+    enum class Filter {
+        Linear, Bicubic, Lanczos3, PixelArt
+    };
+
+    // 知らない名前ならLanczos3
+    Filter parse(const std::string &name);
+    const char *name(Filter filter);
+
+    // poolがあれば行毎に分けて並列に処理する
+    std::vector<unsigned char> resize(const unsigned char *src, int src_w, int src_h, int dst_w, int dst_h, Filter filter, ThreadPool *pool);
+}
+
+#endif // RESAMPLE_H_
@@ -12,8 +12,8 @@ WrapSurface::WrapSurface(int w, int h) : is_upconverted_(false) {
     surface_ = SDL_CreateSurface(w, h, SDL_PIXELFORMAT_ABGR8888);
 }
 
-WrapSurface::WrapSurface(ImageInfo &info) : is_upconverted_(info.isUpconverted()) {
-    surface_ = SDL_CreateSurfaceFrom(info.width(), info.height(), SDL_PIXELFORMAT_ABGR8888, info.get().data(), info.width() * 4);
+WrapSurface::WrapSurface(const ImageInfo &info) : buffer_(info.buffer()), is_upconverted_(info.isUpconverted()) {
+    surface_ = SDL_CreateSurfaceFrom(info.width(), info.height(), SDL_PIXELFORMAT_ABGR8888, const_cast<unsigned char *>(info.data()), info.width() * 4);
 }
 
 WrapSurface::~WrapSurface() {
@@ -44,7 +44,7 @@ TextureCache::~TextureCache() {
 }
 
 std::unique_ptr<WrapTexture> &TextureCache::get(const std::filesystem::path &path, SDL_Renderer *renderer, std::unique_ptr<ImageCache> &image_cache) {
-    auto &info = image_cache->get(path);
+    auto info = image_cache->get(path);
     if (!info) {
         return invalid_texture;
     }
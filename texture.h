@@ -16,10 +16,12 @@
 class WrapSurface {
     private:
         SDL_Surface *surface_;
+        // surface_が参照している画素
+        std::shared_ptr<const ImageBuffer> buffer_;
         bool is_upconverted_;
     public:
         WrapSurface(int w, int h);
-        WrapSurface(ImageInfo &info);
+        WrapSurface(const ImageInfo &info);
         ~WrapSurface();
         SDL_Surface *surface() {
             return surface_;
@@ -0,0 +1,45 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+namespace {
+    constexpr int kMaxThreads = 4;
+}
+
+ThreadPool::ThreadPool(int num_threads) : alive_(true) {
+    if (num_threads <= 0) {
+        // メインスレッドの分は残しておく
+        num_threads = std::clamp(static_cast<int>(std::thread::hardware_concurrency()) - 1, 1, kMaxThreads);
+    }
+    for (int i = 0; i < num_threads; i++) {
+        threads_.emplace_back([this]() {
+            while (true) {
+                std::function<void()> task;
+                {
+                    std::unique_lock<std::mutex> lock(mutex_);
+                    cond_.wait(lock, [this]() { return !alive_ || !queue_.empty(); });
+                    if (!alive_) {
+                        break;
+                    }
+                    task = std::move(queue_.front());
+                    queue_.pop();
+                }
+                task();
+            }
+        });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    // まだ始まっていないものは捨てる、待っている側にはbroken_promiseが返る
+    std::queue<std::function<void()>> dropped;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        alive_ = false;
+        dropped.swap(queue_);
+    }
+    cond_.notify_all();
+    for (auto &th : threads_) {
+        th.join();
+    }
+}
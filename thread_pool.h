@@ -0,0 +1,83 @@
+#ifndef THREAD_POOL_H_
+#define THREAD_POOL_H_
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+    private:
+        bool alive_;
+        std::mutex mutex_;
+        std::condition_variable cond_;
+        std::queue<std::function<void()>> queue_;
+        std::vector<std::thread> threads_;
+    public:
+        // 0ならCPUの数から決める
+        ThreadPool(int num_threads = 0);
+        ~ThreadPool();
+        int size() const {
+            return threads_.size();
+        }
+        template<typename F>
+        auto submit(F &&f) -> std::future<decltype(f())> {
+            auto task = std::make_shared<std::packaged_task<decltype(f())()>>(std::forward<F>(f));
+            auto future = task->get_future();
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                queue_.push([task]() {
+                    (*task)();
+                });
+            }
+            cond_.notify_one();
+            return future;
+        }
+        // f(0)からf(n - 1)までを分けて実行し、全て終わるまで待つ
+        // 呼び出したスレッドも処理に加わるので、poolが他の仕事で埋まっていても止まらない
+        template<typename F>
+        void parallelFor(int n, F &&f) {
+            struct State {
+                std::atomic<int> next = 0, done = 0;
+                std::mutex mutex;
+                std::condition_variable cond;
+            };
+            if (n <= 0) {
+                return;
+            }
+            auto state = std::make_shared<State>();
+            auto *func = &f;
+            // 取り損ねたものはfに触らないので、呼び出し元が戻った後に動いても良い
+            auto run = [state, func, n]() {
+                int i;
+                while ((i = state->next++) < n) {
+                    (*func)(i);
+                    if (++state->done == n) {
+                        std::unique_lock<std::mutex> lock(state->mutex);
+                        state->cond.notify_all();
+                    }
+                }
+            };
+            int helpers = std::min(size(), n - 1);
+            if (helpers > 0) {
+                {
+                    std::unique_lock<std::mutex> lock(mutex_);
+                    for (int i = 0; i < helpers; i++) {
+                        queue_.push(run);
+                    }
+                }
+                cond_.notify_all();
+            }
+            run();
+            std::unique_lock<std::mutex> lock(state->mutex);
+            state->cond.wait(lock, [&]() { return state->done == n; });
+        }
+};
+
+#endif // THREAD_POOL_H_
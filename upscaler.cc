@@ -0,0 +1,445 @@
+#include "upscaler.h"
+#include "misc.h"
+
+#if defined(USE_ONNX)
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <thread>
+
+#include "image_kernel.h"
+#include "logger.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define UPSCALER_USE_X86 1
+#endif // x86
+
+namespace {
+    // タイルのうち他と重ならない部分の大きさと、周りに付ける重なりの幅(入力の画素数)
+    constexpr int kTile = 128;
+    constexpr int kOverlap = 8;
+    constexpr int kMaxThreads = 4;
+
+    // RGBAの1行をチャンネル毎の面に分けて0-1にする
+    void toPlanarScalar(const unsigned char *src, int n, float *r, float *g, float *b, float *a, int begin) {
+        for (int i = begin; i < n; i++) {
+            r[i] = src[4 * i + 0] / 255.0f;
+            g[i] = src[4 * i + 1] / 255.0f;
+            b[i] = src[4 * i + 2] / 255.0f;
+            a[i] = src[4 * i + 3] / 255.0f;
+        }
+    }
+
+    void toPlanarScalar(const unsigned char *src, int n, float *r, float *g, float *b, float *a) {
+        toPlanarScalar(src, n, r, g, b, a, 0);
+    }
+
+    // 面に分かれた1行にweightを掛けてaccに足し、weightの合計も足しておく
+    // planes[3]がnullptrならalphaの分は足さない
+    void accumulateScalar(const float *const *planes, const float *wx, float wy, int n, float *acc, float *weight, int begin) {
+        int channels = (planes[3] != nullptr) ? (4) : (3);
+        for (int i = begin; i < n; i++) {
+            float w = wx[i] * wy;
+            for (int c = 0; c < channels; c++) {
+                acc[4 * i + c] += w * planes[c][i];
+            }
+            weight[i] += w;
+        }
+    }
+
+    void accumulateScalar(const float *const *planes, const float *wx, float wy, int n, float *acc, float *weight) {
+        accumulateScalar(planes, wx, wy, n, acc, weight, 0);
+    }
+
+    // 重みの合計で割って0-255にする
+    void resolveScalar(const float *acc, const float *weight, int n, unsigned char *dst, int begin) {
+        for (int i = begin; i < n; i++) {
+            float f = (weight[i] > 0) ? (255.0f / weight[i]) : (0);
+            for (int c = 0; c < 4; c++) {
+                int byte = std::round(acc[4 * i + c] * f);
+                dst[4 * i + c] = std::max(0, std::min(255, byte));
+            }
+        }
+    }
+
+    void resolveScalar(const float *acc, const float *weight, int n, unsigned char *dst) {
+        resolveScalar(acc, weight, n, dst, 0);
+    }
+
+    // RGBAの1行をpremultipliedなRGBの面に分けて0-1にする
+    void toPremultipliedScalar(const unsigned char *src, int n, float *r, float *g, float *b, int begin) {
+        for (int i = begin; i < n; i++) {
+            float a = src[4 * i + 3] / (255.0f * 255.0f);
+            r[i] = src[4 * i + 0] * a;
+            g[i] = src[4 * i + 1] * a;
+            b[i] = src[4 * i + 2] * a;
+        }
+    }
+
+    void toPremultipliedScalar(const unsigned char *src, int n, float *r, float *g, float *b) {
+        toPremultipliedScalar(src, n, r, g, b, 0);
+    }
+
+    // 重みの合計で割ってからalphaで割り戻し、0-255にする
+    // accのalphaの分は使わずにalphaを入れる
+    void resolvePremultipliedScalar(const float *acc, const float *weight, const unsigned char *alpha, int n, unsigned char *dst, int begin) {
+        for (int i = begin; i < n; i++) {
+            float f = (weight[i] > 0 && alpha[i] > 0) ? (255.0f * 255.0f / (weight[i] * alpha[i])) : (0);
+            for (int c = 0; c < 3; c++) {
+                int byte = std::round(acc[4 * i + c] * f);
+                dst[4 * i + c] = std::max(0, std::min(255, byte));
+            }
+            dst[4 * i + 3] = alpha[i];
+        }
+    }
+
+    void resolvePremultipliedScalar(const float *acc, const float *weight, const unsigned char *alpha, int n, unsigned char *dst) {
+        resolvePremultipliedScalar(acc, weight, alpha, n, dst, 0);
+    }
+
+#if defined(UPSCALER_USE_X86)
+    // 4画素ずつ、画素毎のRGBAをfloatにしてから転置する
+    __attribute__((target("sse2")))
+    void toPlanarSSE2(const unsigned char *src, int n, float *r, float *g, float *b, float *a) {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128 scale = _mm_set1_ps(1.0f / 255.0f);
+        int i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 4 * i));
+            __m128i lo = _mm_unpacklo_epi8(v, zero);
+            __m128i hi = _mm_unpackhi_epi8(v, zero);
+            __m128 p0 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)), scale);
+            __m128 p1 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)), scale);
+            __m128 p2 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)), scale);
+            __m128 p3 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)), scale);
+            _MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+            _mm_storeu_ps(r + i, p0);
+            _mm_storeu_ps(g + i, p1);
+            _mm_storeu_ps(b + i, p2);
+            _mm_storeu_ps(a + i, p3);
+        }
+        toPlanarScalar(src, n, r, g, b, a, i);
+    }
+
+    __attribute__((target("sse2")))
+    void accumulateSSE2(const float *const *planes, const float *wx, float wy, int n, float *acc, float *weight) {
+        const __m128 vy = _mm_set1_ps(wy);
+        int i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m128 w = _mm_mul_ps(_mm_loadu_ps(wx + i), vy);
+            __m128 p0 = _mm_loadu_ps(planes[0] + i);
+            __m128 p1 = _mm_loadu_ps(planes[1] + i);
+            __m128 p2 = _mm_loadu_ps(planes[2] + i);
+            __m128 p3 = (planes[3] != nullptr) ? (_mm_loadu_ps(planes[3] + i)) : (_mm_setzero_ps());
+            _MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+            float *d = acc + 4 * i;
+            _mm_storeu_ps(d + 0, _mm_add_ps(_mm_loadu_ps(d + 0), _mm_mul_ps(p0, _mm_shuffle_ps(w, w, 0x00))));
+            _mm_storeu_ps(d + 4, _mm_add_ps(_mm_loadu_ps(d + 4), _mm_mul_ps(p1, _mm_shuffle_ps(w, w, 0x55))));
+            _mm_storeu_ps(d + 8, _mm_add_ps(_mm_loadu_ps(d + 8), _mm_mul_ps(p2, _mm_shuffle_ps(w, w, 0xaa))));
+            _mm_storeu_ps(d + 12, _mm_add_ps(_mm_loadu_ps(d + 12), _mm_mul_ps(p3, _mm_shuffle_ps(w, w, 0xff))));
+            _mm_storeu_ps(weight + i, _mm_add_ps(_mm_loadu_ps(weight + i), w));
+        }
+        accumulateScalar(planes, wx, wy, n, acc, weight, i);
+    }
+
+    __attribute__((target("sse2")))
+    void resolveSSE2(const float *acc, const float *weight, int n, unsigned char *dst) {
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 scale = _mm_set1_ps(255.0f);
+        int i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m128 w = _mm_loadu_ps(weight + i);
+            // 重みが0のところは0にする
+            __m128 f = _mm_and_ps(_mm_div_ps(scale, w), _mm_cmpgt_ps(w, zero));
+            __m128i p0 = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(acc + 4 * i + 0), _mm_shuffle_ps(f, f, 0x00)));
+            __m128i p1 = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(acc + 4 * i + 4), _mm_shuffle_ps(f, f, 0x55)));
+            __m128i p2 = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(acc + 4 * i + 8), _mm_shuffle_ps(f, f, 0xaa)));
+            __m128i p3 = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(acc + 4 * i + 12), _mm_shuffle_ps(f, f, 0xff)));
+            // 飽和させながら詰めるので0-255に収まる
+            __m128i v = _mm_packus_epi16(_mm_packs_epi32(p0, p1), _mm_packs_epi32(p2, p3));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 4 * i), v);
+        }
+        resolveScalar(acc, weight, n, dst, i);
+    }
+
+    __attribute__((target("sse2")))
+    void toPremultipliedSSE2(const unsigned char *src, int n, float *r, float *g, float *b) {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128 scale = _mm_set1_ps(1.0f / 255.0f);
+        int i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 4 * i));
+            __m128i lo = _mm_unpacklo_epi8(v, zero);
+            __m128i hi = _mm_unpackhi_epi8(v, zero);
+            __m128 p0 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)), scale);
+            __m128 p1 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)), scale);
+            __m128 p2 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)), scale);
+            __m128 p3 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)), scale);
+            // 各画素をその画素のalphaで掛ける
+            p0 = _mm_mul_ps(p0, _mm_shuffle_ps(p0, p0, 0xff));
+            p1 = _mm_mul_ps(p1, _mm_shuffle_ps(p1, p1, 0xff));
+            p2 = _mm_mul_ps(p2, _mm_shuffle_ps(p2, p2, 0xff));
+            p3 = _mm_mul_ps(p3, _mm_shuffle_ps(p3, p3, 0xff));
+            _MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+            _mm_storeu_ps(r + i, p0);
+            _mm_storeu_ps(g + i, p1);
+            _mm_storeu_ps(b + i, p2);
+        }
+        toPremultipliedScalar(src, n, r, g, b, i);
+    }
+
+    __attribute__((target("sse2")))
+    void resolvePremultipliedSSE2(const float *acc, const float *weight, const unsigned char *alpha, int n, unsigned char *dst) {
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 scale = _mm_set1_ps(255.0f * 255.0f);
+        const __m128i mask = _mm_set1_epi32(0x00ffffff);
+        int i = 0;
+        for (; i + 4 <= n; i += 4) {
+            int32_t a4;
+            memcpy(&a4, alpha + i, 4);
+            __m128i ai = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(a4), _mm_setzero_si128()), _mm_setzero_si128());
+            __m128 d = _mm_mul_ps(_mm_loadu_ps(weight + i), _mm_cvtepi32_ps(ai));
+            // 重みかalphaが0のところは0にする
+            __m128 f = _mm_and_ps(_mm_div_ps(scale, d), _mm_cmpgt_ps(d, zero));
+            __m128i p0 = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(acc + 4 * i + 0), _mm_shuffle_ps(f, f, 0x00)));
+            __m128i p1 = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(acc + 4 * i + 4), _mm_shuffle_ps(f, f, 0x55)));
+            __m128i p2 = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(acc + 4 * i + 8), _mm_shuffle_ps(f, f, 0xaa)));
+            __m128i p3 = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(acc + 4 * i + 12), _mm_shuffle_ps(f, f, 0xff)));
+            // 飽和させながら詰めるので0-255に収まる、4番目はalphaで置き換える
+            __m128i v = _mm_packus_epi16(_mm_packs_epi32(p0, p1), _mm_packs_epi32(p2, p3));
+            v = _mm_or_si128(_mm_and_si128(v, mask), _mm_slli_epi32(ai, 24));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 4 * i), v);
+        }
+        resolvePremultipliedScalar(acc, weight, alpha, n, dst, i);
+    }
+
+    using ToPlanarFunc = void (*)(const unsigned char *, int, float *, float *, float *, float *);
+    using AccumulateFunc = void (*)(const float *const *, const float *, float, int, float *, float *);
+    using ResolveFunc = void (*)(const float *, const float *, int, unsigned char *);
+    using ToPremultipliedFunc = void (*)(const unsigned char *, int, float *, float *, float *);
+    using ResolvePremultipliedFunc = void (*)(const float *, const float *, const unsigned char *, int, unsigned char *);
+
+    bool hasSSE2() {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("sse2");
+    }
+
+    const ToPlanarFunc to_planar = (hasSSE2()) ? (static_cast<ToPlanarFunc>(toPlanarSSE2)) : (static_cast<ToPlanarFunc>(toPlanarScalar));
+    const AccumulateFunc accumulate = (hasSSE2()) ? (static_cast<AccumulateFunc>(accumulateSSE2)) : (static_cast<AccumulateFunc>(accumulateScalar));
+    const ResolveFunc resolve = (hasSSE2()) ? (static_cast<ResolveFunc>(resolveSSE2)) : (static_cast<ResolveFunc>(resolveScalar));
+    const ToPremultipliedFunc to_premultiplied = (hasSSE2()) ? (static_cast<ToPremultipliedFunc>(toPremultipliedSSE2)) : (static_cast<ToPremultipliedFunc>(toPremultipliedScalar));
+    const ResolvePremultipliedFunc resolve_premultiplied = (hasSSE2()) ? (static_cast<ResolvePremultipliedFunc>(resolvePremultipliedSSE2)) : (static_cast<ResolvePremultipliedFunc>(resolvePremultipliedScalar));
+#else
+    const auto to_planar = static_cast<void (*)(const unsigned char *, int, float *, float *, float *, float *)>(toPlanarScalar);
+    const auto accumulate = static_cast<void (*)(const float *const *, const float *, float, int, float *, float *)>(accumulateScalar);
+    const auto resolve = static_cast<void (*)(const float *, const float *, int, unsigned char *)>(resolveScalar);
+    const auto to_premultiplied = static_cast<void (*)(const unsigned char *, int, float *, float *, float *)>(toPremultipliedScalar);
+    const auto resolve_premultiplied = static_cast<void (*)(const float *, const float *, const unsigned char *, int, unsigned char *)>(resolvePremultipliedScalar);
+#endif // UPSCALER_USE_X86
+
+    // alphaだけを双線形で2倍にする
+    std::vector<unsigned char> upscaleAlpha(const unsigned char *src, int w, int h) {
+        std::vector<unsigned char> dst(4 * static_cast<size_t>(w) * h);
+        auto at = [&](int x, int y) {
+            return static_cast<int>(src[4 * (static_cast<size_t>(std::clamp(y, 0, h - 1)) * w + std::clamp(x, 0, w - 1)) + 3]);
+        };
+        for (int oy = 0; oy < 2 * h; oy++) {
+            // 出力の画素の中心は入力の座標で(o + 0.5) / 2 - 0.5、隣の画素との比は1:3
+            int y = oy / 2, ny = (oy & 1) ? (y + 1) : (y - 1);
+            unsigned char *d = dst.data() + static_cast<size_t>(oy) * 2 * w;
+            for (int ox = 0; ox < 2 * w; ox++) {
+                int x = ox / 2, nx = (ox & 1) ? (x + 1) : (x - 1);
+                int v = 9 * at(x, y) + 3 * at(nx, y) + 3 * at(x, ny) + at(nx, ny);
+                d[ox] = (v + 8) / 16;
+            }
+        }
+        return dst;
+    }
+
+    // 入力の範囲に不透明な画素があるか
+    bool hasAlpha(const unsigned char *src, int w, int x0, int y0, int tw, int th) {
+        for (int y = y0; y < y0 + th; y++) {
+            const unsigned char *p = src + 4 * (static_cast<size_t>(y) * w + x0);
+            for (int x = 0; x < tw; x++) {
+                if (p[4 * x + 3] != 0) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    // タイルの左端からposの位置の重み
+    // 隣のタイルと重なる部分だけ端に向かって小さくする
+    float ramp(int pos, int size, bool has_before, bool has_after) {
+        // 出力は2倍なので重なりの幅も2倍
+        float r = 2 * kOverlap;
+        float w = 1;
+        if (has_before) {
+            w = std::min(w, (pos + 0.5f) / r);
+        }
+        if (has_after) {
+            w = std::min(w, (size - pos - 0.5f) / r);
+        }
+        return w;
+    }
+
+    // 長さnをタイルに分けたときの各タイルの始まり
+    std::vector<int> tileOrigins(int n, int tile) {
+        std::vector<int> list;
+        if (n <= tile) {
+            list.push_back(0);
+            return list;
+        }
+        for (int core = 0; core < n; core += kTile) {
+            int x0 = std::clamp(core - kOverlap, 0, n - tile);
+            if (list.empty() || list.back() != x0) {
+                list.push_back(x0);
+            }
+            if (x0 + tile >= n) {
+                break;
+            }
+        }
+        return list;
+    }
+}
+
+Upscaler::Upscaler(const std::filesystem::path &model_path, int num_threads, bool premultiplied)
+    : session_(nullptr), mem_info_(Ort::MemoryInfo::CreateCpu(OrtDeviceAllocator, OrtMemTypeCPU)), premultiplied_(premultiplied), channels_((premultiplied) ? (3) : (4)), tile_w_(0), tile_h_(0), input_tensor_(nullptr), output_tensor_(nullptr) {
+    if (num_threads <= 0) {
+        num_threads = std::clamp(static_cast<int>(std::thread::hardware_concurrency()) / 2, 1, kMaxThreads);
+    }
+    Ort::SessionOptions session_options;
+    session_options.SetIntraOpNumThreads(num_threads);
+    session_options.SetInterOpNumThreads(1);
+    session_options.SetGraphOptimizationLevel(ORT_ENABLE_ALL);
+#if defined(IS_WINDOWS)
+    session_ = {env_, model_path.wstring().c_str(), session_options};
+#else
+    session_ = {env_, model_path.string().c_str(), session_options};
+#endif // Windows
+    binding_ = std::make_unique<Ort::IoBinding>(session_);
+    Logger::log("upscaler: threads", num_threads, "channels", channels_);
+}
+
+void Upscaler::prepare(int tile_w, int tile_h) {
+    if (tile_w == tile_w_ && tile_h == tile_h_) {
+        return;
+    }
+    tile_w_ = tile_w;
+    tile_h_ = tile_h;
+    // 各チャンネルをバッチとして1チャンネルの画像にする
+    std::array<int64_t, 4> input_shape = {channels_, 1, tile_h, tile_w};
+    std::array<int64_t, 4> output_shape = {channels_, 1, 2 * tile_h, 2 * tile_w};
+    input_.assign(channels_ * static_cast<size_t>(tile_w) * tile_h, 0);
+    output_.assign(4 * channels_ * static_cast<size_t>(tile_w) * tile_h, 0);
+    input_tensor_ = Ort::Value::CreateTensor<float>(mem_info_, input_.data(), input_.size(), input_shape.data(), input_shape.size());
+    output_tensor_ = Ort::Value::CreateTensor<float>(mem_info_, output_.data(), output_.size(), output_shape.data(), output_shape.size());
+    binding_->ClearBoundInputs();
+    binding_->ClearBoundOutputs();
+    binding_->BindInput("input", input_tensor_);
+    binding_->BindOutput("output", output_tensor_);
+}
+
+void Upscaler::runTile(const unsigned char *src, int w, int h, int x0, int y0, int acc_top) {
+    size_t plane = static_cast<size_t>(tile_w_) * tile_h_;
+    for (int y = 0; y < tile_h_; y++) {
+        size_t offset = static_cast<size_t>(y) * tile_w_;
+        const unsigned char *p = src + 4 * (static_cast<size_t>(y0 + y) * w + x0);
+        if (premultiplied_) {
+            to_premultiplied(p, tile_w_, input_.data() + offset, input_.data() + plane + offset, input_.data() + 2 * plane + offset);
+        }
+        else {
+            to_planar(p, tile_w_, input_.data() + offset, input_.data() + plane + offset, input_.data() + 2 * plane + offset, input_.data() + 3 * plane + offset);
+        }
+    }
+    Ort::RunOptions run_options;
+    session_.Run(run_options, *binding_);
+
+    int out_w = 2 * w;
+    int ow = 2 * tile_w_, oh = 2 * tile_h_;
+    size_t out_plane = static_cast<size_t>(ow) * oh;
+    // 隣のタイルがある側だけ重みを下げる
+    bool left = x0 > 0, right = x0 + tile_w_ < w;
+    bool top = y0 > 0, bottom = y0 + tile_h_ < h;
+    std::vector<float> wx(ow);
+    for (int x = 0; x < ow; x++) {
+        wx[x] = ramp(x, ow, left, right);
+    }
+    for (int y = 0; y < oh; y++) {
+        float wy = ramp(y, oh, top, bottom);
+        size_t offset = static_cast<size_t>(y) * ow;
+        const float *planes[4] = {
+            output_.data() + offset,
+            output_.data() + out_plane + offset,
+            output_.data() + 2 * out_plane + offset,
+            (premultiplied_) ? (nullptr) : (output_.data() + 3 * out_plane + offset),
+        };
+        size_t row = static_cast<size_t>(2 * y0 + y - acc_top) * out_w + 2 * x0;
+        accumulate(planes, wx.data(), wy, ow, acc_.data() + 4 * row, weight_.data() + row);
+    }
+}
+
+std::vector<unsigned char> Upscaler::upscale(const unsigned char *src, int w, int h, const std::function<bool()> &cancelled) {
+    int tile_w = std::min(w, kTile + 2 * kOverlap);
+    int tile_h = std::min(h, kTile + 2 * kOverlap);
+    prepare(tile_w, tile_h);
+    int out_w = 2 * w, out_h = 2 * h;
+    std::vector<unsigned char> dst(4 * static_cast<size_t>(out_w) * out_h);
+    auto xs = tileOrigins(w, tile_w);
+    auto ys = tileOrigins(h, tile_h);
+    // タイル1行分の出力だけを持っておき、下のタイルと重ならない行から確定させる
+    size_t rows = 2 * tile_h;
+    std::vector<unsigned char> alpha;
+    if (premultiplied_) {
+        alpha = upscaleAlpha(src, w, h);
+    }
+    int skipped = 0;
+    acc_.assign(4 * rows * out_w, 0);
+    weight_.assign(rows * out_w, 0);
+    for (size_t j = 0; j < ys.size(); j++) {
+        int acc_top = 2 * ys[j];
+        for (int x0 : xs) {
+            // 全て透明なタイルは結果も透明なので飛ばす
+            // 周りのタイルと重なる部分は重みの合計で割るので影響しない
+            if (!hasAlpha(src, w, x0, ys[j], tile_w, tile_h)) {
+                skipped++;
+                continue;
+            }
+            if (cancelled && cancelled()) {
+                return {};
+            }
+            runTile(src, w, h, x0, ys[j], acc_top);
+        }
+        int done = (j + 1 < ys.size()) ? (2 * ys[j + 1]) : (out_h);
+        for (int y = acc_top; y < done; y++) {
+            size_t row = static_cast<size_t>(y - acc_top) * out_w;
+            unsigned char *d = dst.data() + 4 * static_cast<size_t>(y) * out_w;
+            if (premultiplied_) {
+                resolve_premultiplied(acc_.data() + 4 * row, weight_.data() + row, alpha.data() + static_cast<size_t>(y) * out_w, out_w, d);
+            }
+            else {
+                resolve(acc_.data() + 4 * row, weight_.data() + row, out_w, d);
+            }
+        }
+        // 確定していない行を先頭に寄せる
+        size_t shift = static_cast<size_t>(done - acc_top) * out_w;
+        std::move(acc_.begin() + 4 * shift, acc_.end(), acc_.begin());
+        std::fill(acc_.end() - 4 * shift, acc_.end(), 0.0f);
+        std::move(weight_.begin() + shift, weight_.end(), weight_.begin());
+        std::fill(weight_.end() - shift, weight_.end(), 0.0f);
+    }
+    if (skipped > 0) {
+        Logger::log("upscaler: skipped", skipped, "/", xs.size() * ys.size(), "tiles");
+    }
+    // 飛ばしたタイルと、premultipliedならalphaが0の部分には色が無いので作り直す
+    if (skipped > 0 || premultiplied_) {
+        image_kernel::bleedAlpha(dst.data(), out_w, out_h);
+    }
+    return dst;
+}
+
+#endif // USE_ONNX
@@ -0,0 +1,47 @@
+#ifndef UPSCALER_H_
+#define UPSCALER_H_
+
+#if defined(USE_ONNX)
+
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <onnxruntime_cxx_api.h>
+
+// model.onnxで画像を2倍にする
+// 画像をタイルに分け、重なった部分は混ぜ合わせてつなぐ
+// テンソルとバッファはタイルの大きさが変わらない限り使い回す
+// 全て透明なタイルはモデルに通さない
+// premultipliedならモデルに通すのはpremultipliedなRGBだけで、alphaは双線形で2倍にする
+class Upscaler {
+    private:
+        Ort::Env env_;
+        Ort::Session session_;
+        Ort::MemoryInfo mem_info_;
+        std::unique_ptr<Ort::IoBinding> binding_;
+        bool premultiplied_;
+        // モデルに通すチャンネルの数
+        int channels_;
+        // 今のテンソルのタイルの大きさ
+        int tile_w_, tile_h_;
+        std::vector<float> input_, output_;
+        Ort::Value input_tensor_, output_tensor_;
+        // 出力のうちまだ確定していない行
+        std::vector<float> acc_, weight_;
+
+        void prepare(int tile_w, int tile_h);
+        void runTile(const unsigned char *src, int w, int h, int x0, int y0, int acc_top);
+    public:
+        // 0ならCPUの数から決める
+        Upscaler(const std::filesystem::path &model_path, int num_threads, bool premultiplied = false);
+        ~Upscaler() {}
+        // 2倍にした画像を返す、失敗したらOrt::Exceptionを投げる
+        // cancelledがタイルの合間にtrueを返したら止めて空を返す
+        std::vector<unsigned char> upscale(const unsigned char *src, int w, int h, const std::function<bool()> &cancelled = {});
+};
+
+#endif // USE_ONNX
+
+#endif // UPSCALER_H_
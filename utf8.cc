@@ -0,0 +1,174 @@
+#include "utf8.h"
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define UTF8_USE_X86 1
+#endif // x86
+
+namespace {
+    size_t skipASCIIScalar(const unsigned char *p, size_t offset, size_t length) {
+        for (; offset + 8 <= length; offset += 8) {
+            uint64_t word;
+            memcpy(&word, p + offset, sizeof(word));
+            if (word & 0x8080808080808080ull) {
+                break;
+            }
+        }
+        for (; offset < length; offset++) {
+            if (p[offset] >= 0x80) {
+                break;
+            }
+        }
+        return offset;
+    }
+
+#if defined(UTF8_USE_X86)
+    __attribute__((target("sse2")))
+    size_t skipASCIISSE2(const unsigned char *p, size_t offset, size_t length) {
+        for (; offset + 16 <= length; offset += 16) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + offset));
+            int mask = _mm_movemask_epi8(v);
+            if (mask) {
+                return offset + __builtin_ctz(mask);
+            }
+        }
+        return skipASCIIScalar(p, offset, length);
+    }
+
+    __attribute__((target("avx2")))
+    size_t skipASCIIAVX2(const unsigned char *p, size_t offset, size_t length) {
+        for (; offset + 32 <= length; offset += 32) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + offset));
+            unsigned int mask = _mm256_movemask_epi8(v);
+            if (mask) {
+                return offset + __builtin_ctz(mask);
+            }
+        }
+        return skipASCIISSE2(p, offset, length);
+    }
+
+    using SkipFunc = size_t (*)(const unsigned char *, size_t, size_t);
+
+    SkipFunc selectSkipASCII() {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            return skipASCIIAVX2;
+        }
+        if (__builtin_cpu_supports("sse2")) {
+            return skipASCIISSE2;
+        }
+        return skipASCIIScalar;
+    }
+
+    const SkipFunc skip_ascii = selectSkipASCII();
+#else
+    const auto skip_ascii = skipASCIIScalar;
+#endif // UTF8_USE_X86
+}
+
+namespace utf8 {
+    CodePoint decode(std::string_view str, size_t offset) {
+        CodePoint invalid = {kReplacement, offset, 1, false};
+        unsigned char c = static_cast<unsigned char>(str[offset]);
+        size_t length;
+        char32_t code;
+        // 2byte目の範囲、冗長な表現とサロゲートを弾く
+        unsigned char lower = 0x80, upper = 0xbf;
+        if (c < 0x80) {
+            return {c, offset, 1, true};
+        }
+        else if (c >= 0xc2 && c < 0xe0) {
+            length = 2;
+            code = c & 0x1f;
+        }
+        else if (c >= 0xe0 && c < 0xf0) {
+            length = 3;
+            code = c & 0x0f;
+            if (c == 0xe0) {
+                lower = 0xa0;
+            }
+            else if (c == 0xed) {
+                upper = 0x9f;
+            }
+        }
+        else if (c >= 0xf0 && c < 0xf5) {
+            length = 4;
+            code = c & 0x07;
+            if (c == 0xf0) {
+                lower = 0x90;
+            }
+            else if (c == 0xf4) {
+                upper = 0x8f;
+            }
+        }
+        else {
+            return invalid;
+        }
+        if (offset + length > str.length()) {
+            return invalid;
+        }
+        for (size_t i = 1; i < length; i++) {
+            unsigned char cc = static_cast<unsigned char>(str[offset + i]);
+            if (cc < lower || cc > upper) {
+                return invalid;
+            }
+            lower = 0x80;
+            upper = 0xbf;
+            code = (code << 6) | (cc & 0x3f);
+        }
+        return {code, offset, length, true};
+    }
+
+    size_t skipASCII(std::string_view str, size_t offset) {
+        if (offset >= str.length()) {
+            return str.length();
+        }
+        return skip_ascii(reinterpret_cast<const unsigned char *>(str.data()), offset, str.length());
+    }
+
+    bool isValid(std::string_view str) {
+        size_t offset = 0;
+        while (true) {
+            offset = skipASCII(str, offset);
+            if (offset >= str.length()) {
+                return true;
+            }
+            auto cp = decode(str, offset);
+            if (!cp.valid) {
+                return false;
+            }
+            offset += cp.length;
+        }
+    }
+
+    size_t prev(std::string_view str, size_t offset) {
+        if (offset == 0) {
+            return 0;
+        }
+        size_t begin = offset - 1;
+        while (begin > 0 && offset - begin < 4 && (static_cast<unsigned char>(str[begin]) & 0xc0) == 0x80) {
+            begin--;
+        }
+        auto cp = decode(str, begin);
+        if (begin + cp.length != offset) {
+            // 不正なバイト列は1byteずつ
+            return offset - 1;
+        }
+        return begin;
+    }
+
+    CodePoint last(std::string_view str) {
+        if (str.empty()) {
+            return {0, 0, 0, true};
+        }
+        size_t begin = prev(str, str.length());
+        auto cp = decode(str, begin);
+        if (begin + cp.length != str.length()) {
+            return {kReplacement, str.length() - 1, 1, false};
+        }
+        return cp;
+    }
+}
@@ -0,0 +1,99 @@
+#ifndef UTF8_H_
+#define UTF8_H_
+
+#include <cstddef>
+#include <iterator>
+#include <string_view>
+
+namespace utf8 {
+    constexpr char32_t kReplacement = 0xfffd;
+
+    struct CodePoint {
+        char32_t code;
+        size_t offset;
+        size_t length;
+        // 不正なバイト列ならfalse、codeはU+FFFDでlengthは1
+        bool valid;
+    };
+
+    // str[offset]から1文字デコードする
+    CodePoint decode(std::string_view str, size_t offset);
+
+    // offset以降で最初に現れる非ASCIIバイトの位置、無ければstr.length()
+    size_t skipASCII(std::string_view str, size_t offset);
+
+    bool isValid(std::string_view str);
+
+    // offsetの直前の文字の先頭位置
+    size_t prev(std::string_view str, size_t offset);
+
+    // 末尾の1文字、空ならcodeは0
+    CodePoint last(std::string_view str);
+
+    // 1文字ずつ取り出すだけのview
+    // ASCIIの連続している区間はskipASCIIでまとめて求めておき
+    // その間は先頭バイトの判定をしない
+    class view {
+        private:
+            std::string_view str_;
+        public:
+            class iterator {
+                private:
+                    std::string_view str_;
+                    CodePoint cp_;
+                    size_t ascii_end_;
+                    void load(size_t offset) {
+                        if (offset >= str_.length()) {
+                            cp_ = {0, str_.length(), 0, true};
+                            return;
+                        }
+                        if (offset >= ascii_end_) {
+                            ascii_end_ = skipASCII(str_, offset);
+                        }
+                        if (offset < ascii_end_) {
+                            cp_ = {static_cast<unsigned char>(str_[offset]), offset, 1, true};
+                        }
+                        else {
+                            cp_ = decode(str_, offset);
+                        }
+                    }
+                public:
+                    using iterator_category = std::forward_iterator_tag;
+                    using value_type = CodePoint;
+                    using difference_type = std::ptrdiff_t;
+                    using pointer = const CodePoint *;
+                    using reference = const CodePoint &;
+                    iterator() : str_(), cp_({0, 0, 0, true}), ascii_end_(0) {}
+                    iterator(std::string_view str, size_t offset) : str_(str), ascii_end_(0) {
+                        load(offset);
+                    }
+                    reference operator*() const {
+                        return cp_;
+                    }
+                    pointer operator->() const {
+                        return &cp_;
+                    }
+                    iterator &operator++() {
+                        load(cp_.offset + cp_.length);
+                        return *this;
+                    }
+                    iterator operator++(int) {
+                        iterator tmp = *this;
+                        ++*this;
+                        return tmp;
+                    }
+                    bool operator==(const iterator &l) const {
+                        return cp_.offset == l.cp_.offset;
+                    }
+            };
+            explicit view(std::string_view str) : str_(str) {}
+            iterator begin() const {
+                return {str_, 0};
+            }
+            iterator end() const {
+                return {str_, str_.length()};
+            }
+    };
+}
+
+#endif // UTF8_H_
@@ -5,6 +5,7 @@
 #include <cstdlib>
 #include <sstream>
 
+#include "conv.h"
 #include "logger.h"
 
 namespace util {
@@ -115,93 +116,18 @@ namespace util {
                 oss << buffer << '\n';
             }
             if (buffer.starts_with("charset,")) {
-                int begin = 8;
-                int end = buffer.length() - 1;
-                for (; begin < buffer.length(); begin++) {
-                    if (buffer[begin] == ' ') {
-                        continue;
-                    }
-                    break;
+                size_t begin = buffer.find_first_not_of(" ", 8);
+                size_t end = buffer.find_last_not_of(" \r");
+                if (begin != std::string::npos && end != std::string::npos && begin <= end) {
+                    charset = buffer.substr(begin, end - begin + 1);
                 }
-                for (; end > 0; end--) {
-                    if (buffer[begin] == ' ') {
-                        continue;
-                    }
-                    break;
-                }
-                charset = buffer.substr(begin, end - begin);
                 Logger::log("charset in ", path, ": ", charset);
             }
         }
         buffer = oss.str();
-        if (charset == "UTF-8" || buffer.empty()) {
+        if (isUTF8(charset) || buffer.empty()) {
             return buffer;
         }
-        std::string converted;
-        converted.resize(buffer.length());
-        do {
-            converted.resize(converted.length() * 2);
-            const char *in = buffer.data();
-            size_t in_length = buffer.length();
-            char *out = converted.data();
-            size_t out_length = converted.length();
-            SDL_iconv_t cd = SDL_iconv_open("UTF-8", charset.c_str());
-            if (reinterpret_cast<size_t>(cd) == SDL_ICONV_ERROR) {
-                Logger::log("iconv_open error");
-                return buffer;
-            }
-            auto err = SDL_iconv(cd, &in, &in_length, &out, &out_length);
-            SDL_iconv_close(cd);
-            if (err == -2) {
-                continue;
-            }
-            else if (err < 0) {
-                Logger::log("iconv error");
-                return buffer;
-            }
-            else {
-                converted.resize(out_length);
-                break;
-            }
-        } while (true);
-        return converted;
-    }
-
-    std::vector<std::string> UTF8Split(const std::string str) {
-        std::vector<std::string> ret;
-        std::string buffer;
-        int remain = 0;
-        for (int i = 0; i < str.length(); i++, remain--) {
-            unsigned char c = static_cast<unsigned char>(str[i]);
-            if (c >= 0x00 && c < 0x80 && remain == 0) {
-                remain = 1;
-                buffer = c;
-                ret.push_back(buffer);
-                buffer.clear();
-            }
-            else if (c >= 0xc2 && c < 0xe0 && remain == 0) {
-                remain = 2;
-                buffer += c;
-            }
-            else if (c >= 0xe0 && c < 0xf0 && remain == 0) {
-                remain = 3;
-                buffer += c;
-            }
-            else if (c >= 0xf0 && c < 0xf5 && remain == 0) {
-                remain = 4;
-                buffer += c;
-            }
-            else if (c >= 0x80 && c < 0xc0 && remain > 0) {
-                buffer += c;
-                if (remain == 1) {
-                    ret.push_back(buffer);
-                    buffer.clear();
-                }
-            }
-            else {
-                remain = 1;
-            }
-        }
-        return ret;
+        return conv(buffer, "UTF-8", charset);
     }
 }
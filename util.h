@@ -37,8 +37,6 @@ namespace util {
     std::string readDescript(std::filesystem::path path);
 
     SDL_DisplayID getCurrentDisplayID();
-
-    std::vector<std::string> UTF8Split(const std::string str);
 }
 
 #endif // UTIL_H_
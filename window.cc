@@ -17,7 +17,7 @@
 Window::Window(Character *parent, SDL_DisplayID id)
     : window_(nullptr), parent_(parent), offset_({0, 0}),
     renderer_(nullptr), redrawn_(false), changed_(false),
-    raise_on_talk_(false) {
+    raise_on_talk_(false), prev_link_id_(-1) {
     if (util::isWayland() && id > 0) {
         SDL_Rect r;
         SDL_GetDisplayBounds(id, &r);
@@ -284,9 +284,9 @@ void Window::motion(const SDL_MouseMotionEvent &event) {
             yi = yi + r.y;
         }
         parent_->hit(xi, yi);
-        auto link = parent_->getLink();
-        if (prev_link_ != link) {
-            prev_link_ = link;
+        auto &link = parent_->getLink();
+        if (prev_link_id_ != link.id) {
+            prev_link_id_ = link.id;
             if (link.content.event.empty()) {
                 if (link.content.is_anchor) {
                     Request anchor = {"NOTIFY", "OnAnchorEnter", {}};
@@ -349,7 +349,7 @@ void Window::button(const SDL_MouseButtonEvent &event) {
         parent_->resetDrag();
     }
     if (event.button == MOUSE_BUTTON_LEFT && !mouse_state_[event.button].press && !mouse_state_[event.button].drag) {
-        auto link = parent_->getLink().content;
+        auto &link = parent_->getLink().content;
         if (!link.event.empty()) {
             if (link.event.starts_with("On")) {
                 Request req = {"NOTIFY", link.event, link.args};
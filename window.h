@@ -51,7 +51,7 @@ class Window {
         bool redrawn_;
         bool changed_;
         bool raise_on_talk_;
-        Link prev_link_;
+        int prev_link_id_;
 #if defined(IS__NIX)
         wl_registry *reg_;
         wl_compositor *compositor_;
@@ -96,6 +96,10 @@ class Window {
         double distance(int x, int y) const;
 
         void clearCache();
+        // 今回は描き直さない
+        void hold() {
+            redrawn_ = false;
+        }
 
         void motion(const SDL_MouseMotionEvent &event);
         void button(const SDL_MouseButtonEvent &event);